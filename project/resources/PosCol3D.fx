@@ -106,6 +106,8 @@ float4 PS_Point(VS_OUTPUT input) : SV_TARGET
 
     // Adjust Normal Map to Tangent Space
     normalMapColor = 2.0f * normalMapColor - float3(1.0f, 1.0f, 1.0f);
+    // BC5 only stores x and y, z follows from the normal being unit length
+    normalMapColor.z = sqrt(saturate(1.0f - dot(normalMapColor.xy, normalMapColor.xy)));
     normalMapColor = normalize(mul(normalMapColor, (float3x3)tangentSpaceAxis));
 
     // Lighting Calculations
@@ -146,6 +148,8 @@ float4 PS_Linear(VS_OUTPUT input) : SV_TARGET
 
     // Adjust Normal Map to Tangent Space
     normalMapColor = 2.0f * normalMapColor - float3(1.0f, 1.0f, 1.0f);
+    // BC5 only stores x and y, z follows from the normal being unit length
+    normalMapColor.z = sqrt(saturate(1.0f - dot(normalMapColor.xy, normalMapColor.xy)));
     normalMapColor = normalize(mul(normalMapColor, (float3x3) tangentSpaceAxis));
 
     // Lighting Calculations
@@ -187,6 +191,8 @@ float4 PS_Anisotropic(VS_OUTPUT input) : SV_TARGET
 
     // Adjust Normal Map to Tangent Space
     normalMapColor = 2.0f * normalMapColor - float3(1.0f, 1.0f, 1.0f);
+    // BC5 only stores x and y, z follows from the normal being unit length
+    normalMapColor.z = sqrt(saturate(1.0f - dot(normalMapColor.xy, normalMapColor.xy)));
     normalMapColor = normalize(mul(normalMapColor, (float3x3) tangentSpaceAxis));
 
     // Lighting Calculations
@@ -0,0 +1,524 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace dae
+{
+	namespace BlockCompression
+	{
+		namespace
+		{
+			uint32_t GetChannel(uint32_t texel, int channel)
+			{
+				return (texel >> (channel * 8)) & 0xFF;
+			}
+
+			uint32_t MakeTexel(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+			{
+				return r | (g << 8) | (b << 16) | (a << 24);
+			}
+
+			// Block bits are little endian, the first field starts at bit 0 of byte 0
+			struct BitWriter
+			{
+				uint64_t low{};
+				uint64_t high{};
+				int position{};
+
+				void Write(uint64_t value, int nrOfBits)
+				{
+					if (position < 64) low |= value << position;
+					if (position + nrOfBits > 64) high |= position < 64 ? value >> (64 - position) : value << (position - 64);
+					position += nrOfBits;
+				}
+
+				void Store(uint8_t* pBlock) const
+				{
+					std::memcpy(pBlock, &low, sizeof(low));
+					std::memcpy(pBlock + sizeof(low), &high, sizeof(high));
+				}
+			};
+
+			struct BitReader
+			{
+				uint64_t low{};
+				uint64_t high{};
+				int position{};
+
+				explicit BitReader(const uint8_t* pBlock)
+				{
+					std::memcpy(&low, pBlock, sizeof(low));
+					std::memcpy(&high, pBlock + sizeof(low), sizeof(high));
+				}
+
+				uint32_t Read(int nrOfBits)
+				{
+					uint64_t value{};
+					if (position >= 64) value = high >> (position - 64);
+					else if (position + nrOfBits <= 64) value = low >> position;
+					else value = (low >> position) | (high << (64 - position));
+
+					position += nrOfBits;
+					return static_cast<uint32_t>(value & ((uint64_t{ 1 } << nrOfBits) - 1));
+				}
+			};
+
+			// Least squares line through the texels: the principal axis of their covariance (power iteration),
+			// from the lowest to the highest projection of a texel on it
+			void FitEndpoints(const uint32_t* pTexels, int nrOfChannels, float* pEndpoint0, float* pEndpoint1)
+			{
+				float mean[4]{};
+				for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+				{
+					for (int channel{ 0 }; channel < nrOfChannels; ++channel)
+					{
+						mean[channel] += static_cast<float>(GetChannel(pTexels[texelIdx], channel)) / TexelsPerBlock;
+					}
+				}
+
+				float covariance[4][4]{};
+				for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+				{
+					float offset[4]{};
+					for (int channel{ 0 }; channel < nrOfChannels; ++channel)
+					{
+						offset[channel] = static_cast<float>(GetChannel(pTexels[texelIdx], channel)) - mean[channel];
+					}
+					for (int row{ 0 }; row < nrOfChannels; ++row)
+					{
+						for (int column{ 0 }; column < nrOfChannels; ++column)
+						{
+							covariance[row][column] += offset[row] * offset[column];
+						}
+					}
+				}
+
+				// Start from the column of the channel that varies most, it can't be orthogonal to the principal axis
+				int widestChannel{ 0 };
+				for (int channel{ 1 }; channel < nrOfChannels; ++channel)
+				{
+					if (covariance[channel][channel] > covariance[widestChannel][widestChannel]) widestChannel = channel;
+				}
+
+				float axis[4]{};
+				for (int channel{ 0 }; channel < nrOfChannels; ++channel)
+				{
+					axis[channel] = covariance[channel][widestChannel];
+				}
+
+				for (int iteration{ 0 }; iteration < 8; ++iteration)
+				{
+					float nextAxis[4]{};
+					float length{};
+					for (int row{ 0 }; row < nrOfChannels; ++row)
+					{
+						for (int column{ 0 }; column < nrOfChannels; ++column)
+						{
+							nextAxis[row] += covariance[row][column] * axis[column];
+						}
+						length += nextAxis[row] * nextAxis[row];
+					}
+
+					// A flat block, every texel is the mean
+					if (length <= 0.f) break;
+
+					length = std::sqrt(length);
+					for (int channel{ 0 }; channel < nrOfChannels; ++channel)
+					{
+						axis[channel] = nextAxis[channel] / length;
+					}
+				}
+
+				float minProjection{};
+				float maxProjection{};
+				for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+				{
+					float projection{};
+					for (int channel{ 0 }; channel < nrOfChannels; ++channel)
+					{
+						projection += (static_cast<float>(GetChannel(pTexels[texelIdx], channel)) - mean[channel]) * axis[channel];
+					}
+					minProjection = std::min(minProjection, projection);
+					maxProjection = std::max(maxProjection, projection);
+				}
+
+				for (int channel{ 0 }; channel < nrOfChannels; ++channel)
+				{
+					pEndpoint0[channel] = std::clamp(mean[channel] + axis[channel] * minProjection, 0.f, 255.f);
+					pEndpoint1[channel] = std::clamp(mean[channel] + axis[channel] * maxProjection, 0.f, 255.f);
+				}
+			}
+
+			// Index of the palette entry closest to the texel, over the first nrOfChannels channels
+			uint32_t FindClosestEntry(uint32_t texel, const uint32_t* pPalette, int paletteSize, int nrOfChannels)
+			{
+				uint32_t closestEntry{};
+				int closestDistance{ INT32_MAX };
+				for (int entry{ 0 }; entry < paletteSize; ++entry)
+				{
+					int distance{};
+					for (int channel{ 0 }; channel < nrOfChannels; ++channel)
+					{
+						const int difference = static_cast<int>(GetChannel(texel, channel)) - static_cast<int>(GetChannel(pPalette[entry], channel));
+						distance += difference * difference;
+					}
+					if (distance < closestDistance)
+					{
+						closestDistance = distance;
+						closestEntry = static_cast<uint32_t>(entry);
+					}
+				}
+				return closestEntry;
+			}
+
+			uint16_t To565(const float* pColor)
+			{
+				const uint32_t r = static_cast<uint32_t>(pColor[0] * 31.f / 255.f + .5f);
+				const uint32_t g = static_cast<uint32_t>(pColor[1] * 63.f / 255.f + .5f);
+				const uint32_t b = static_cast<uint32_t>(pColor[2] * 31.f / 255.f + .5f);
+				return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+			}
+
+			uint32_t From565(uint16_t color)
+			{
+				const uint32_t r = (color >> 11) & 31;
+				const uint32_t g = (color >> 5) & 63;
+				const uint32_t b = color & 31;
+				return MakeTexel((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255);
+			}
+
+			// color0 > color1 is the opaque four color mode, otherwise the last entry is transparent black
+			void GetBC1Palette(uint16_t color0, uint16_t color1, uint32_t* pPalette)
+			{
+				pPalette[0] = From565(color0);
+				pPalette[1] = From565(color1);
+
+				uint32_t third{};
+				uint32_t twoThirds{};
+				for (int channel{ 0 }; channel < 3; ++channel)
+				{
+					const uint32_t value0 = GetChannel(pPalette[0], channel);
+					const uint32_t value1 = GetChannel(pPalette[1], channel);
+
+					if (color0 > color1)
+					{
+						third |= ((2 * value0 + value1 + 1) / 3) << (channel * 8);
+						twoThirds |= ((value0 + 2 * value1 + 1) / 3) << (channel * 8);
+					}
+					else
+					{
+						third |= ((value0 + value1 + 1) / 2) << (channel * 8);
+					}
+				}
+
+				pPalette[2] = third | 0xFF000000;
+				pPalette[3] = color0 > color1 ? twoThirds | 0xFF000000 : 0;
+			}
+
+			// endpoint0 > endpoint1 interpolates 6 values, otherwise 4 values and 0 and 255
+			void GetChannelPalette(uint32_t endpoint0, uint32_t endpoint1, uint32_t* pPalette)
+			{
+				pPalette[0] = endpoint0;
+				pPalette[1] = endpoint1;
+
+				if (endpoint0 > endpoint1)
+				{
+					for (uint32_t entry{ 2 }; entry < 8; ++entry)
+					{
+						pPalette[entry] = ((8 - entry) * endpoint0 + (entry - 1) * endpoint1 + 3) / 7;
+					}
+				}
+				else
+				{
+					for (uint32_t entry{ 2 }; entry < 6; ++entry)
+					{
+						pPalette[entry] = ((6 - entry) * endpoint0 + (entry - 1) * endpoint1 + 2) / 5;
+					}
+					pPalette[6] = 0;
+					pPalette[7] = 255;
+				}
+			}
+
+			// BC4 block of one channel of the texels
+			void EncodeChannel(const uint32_t* pTexels, int channel, uint8_t* pBlock)
+			{
+				uint32_t minValue{ 255 };
+				uint32_t maxValue{ 0 };
+				for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+				{
+					minValue = std::min(minValue, GetChannel(pTexels[texelIdx], channel));
+					maxValue = std::max(maxValue, GetChannel(pTexels[texelIdx], channel));
+				}
+
+				// A flat block keeps every index at 0, the first endpoint
+				uint64_t indices{};
+				if (maxValue > minValue)
+				{
+					uint32_t palette[8];
+					GetChannelPalette(maxValue, minValue, palette);
+
+					for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+					{
+						const int value = static_cast<int>(GetChannel(pTexels[texelIdx], channel));
+
+						uint64_t closestEntry{};
+						int closestDistance{ 256 };
+						for (int entry{ 0 }; entry < 8; ++entry)
+						{
+							const int distance = std::abs(value - static_cast<int>(palette[entry]));
+							if (distance < closestDistance)
+							{
+								closestDistance = distance;
+								closestEntry = static_cast<uint64_t>(entry);
+							}
+						}
+						indices |= closestEntry << (3 * texelIdx);
+					}
+				}
+
+				pBlock[0] = static_cast<uint8_t>(maxValue);
+				pBlock[1] = static_cast<uint8_t>(minValue);
+				for (int byteIdx{ 0 }; byteIdx < 6; ++byteIdx)
+				{
+					pBlock[2 + byteIdx] = static_cast<uint8_t>(indices >> (8 * byteIdx));
+				}
+			}
+
+			void DecodeChannel(const uint8_t* pBlock, uint32_t* pValues)
+			{
+				uint32_t palette[8];
+				GetChannelPalette(pBlock[0], pBlock[1], palette);
+
+				uint64_t indices{};
+				for (int byteIdx{ 0 }; byteIdx < 6; ++byteIdx)
+				{
+					indices |= static_cast<uint64_t>(pBlock[2 + byteIdx]) << (8 * byteIdx);
+				}
+
+				for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+				{
+					pValues[texelIdx] = palette[(indices >> (3 * texelIdx)) & 7];
+				}
+			}
+
+			constexpr uint32_t BC7Weights[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+			void GetBC7Palette(const uint32_t* pEndpoint0, const uint32_t* pEndpoint1, uint32_t* pPalette)
+			{
+				for (int entry{ 0 }; entry < 16; ++entry)
+				{
+					uint32_t texel{};
+					for (int channel{ 0 }; channel < 4; ++channel)
+					{
+						const uint32_t value = ((64 - BC7Weights[entry]) * pEndpoint0[channel] + BC7Weights[entry] * pEndpoint1[channel] + 32) >> 6;
+						texel |= value << (channel * 8);
+					}
+					pPalette[entry] = texel;
+				}
+			}
+
+			// Mode 6 endpoints are 7 bits per channel plus one p-bit shared by the channels, the p-bit that fits best is picked
+			uint32_t QuantizeBC7Endpoint(const float* pEndpoint, uint32_t* pQuantized)
+			{
+				float errors[2]{};
+				uint32_t quantized[2][4]{};
+				for (uint32_t pBit{ 0 }; pBit < 2; ++pBit)
+				{
+					for (int channel{ 0 }; channel < 4; ++channel)
+					{
+						const float value = std::clamp((pEndpoint[channel] - pBit) * .5f + .5f, 0.f, 127.f);
+						quantized[pBit][channel] = static_cast<uint32_t>(value);
+
+						const float error = static_cast<float>((quantized[pBit][channel] << 1) | pBit) - pEndpoint[channel];
+						errors[pBit] += error * error;
+					}
+				}
+
+				const uint32_t pBit = errors[1] < errors[0] ? 1 : 0;
+				std::copy(quantized[pBit], quantized[pBit] + 4, pQuantized);
+				return pBit;
+			}
+		}
+
+		void EncodeBC1(const uint32_t* pTexels, uint8_t* pBlock)
+		{
+			float endpoint0[4];
+			float endpoint1[4];
+			FitEndpoints(pTexels, 3, endpoint0, endpoint1);
+
+			uint16_t color0 = To565(endpoint1);
+			uint16_t color1 = To565(endpoint0);
+			if (color0 < color1) std::swap(color0, color1);
+
+			// Equal endpoints are the three color mode, but with every index at 0 the block stays opaque
+			uint32_t indices{};
+			if (color0 != color1)
+			{
+				uint32_t palette[4];
+				GetBC1Palette(color0, color1, palette);
+
+				for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+				{
+					indices |= FindClosestEntry(pTexels[texelIdx], palette, 4, 3) << (2 * texelIdx);
+				}
+			}
+
+			std::memcpy(pBlock, &color0, sizeof(color0));
+			std::memcpy(pBlock + 2, &color1, sizeof(color1));
+			std::memcpy(pBlock + 4, &indices, sizeof(indices));
+		}
+
+		void DecodeBC1(const uint8_t* pBlock, uint32_t* pTexels)
+		{
+			uint16_t color0;
+			uint16_t color1;
+			uint32_t indices;
+			std::memcpy(&color0, pBlock, sizeof(color0));
+			std::memcpy(&color1, pBlock + 2, sizeof(color1));
+			std::memcpy(&indices, pBlock + 4, sizeof(indices));
+
+			uint32_t palette[4];
+			GetBC1Palette(color0, color1, palette);
+
+			for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+			{
+				pTexels[texelIdx] = palette[(indices >> (2 * texelIdx)) & 3];
+			}
+		}
+
+		void EncodeBC4(const uint32_t* pTexels, uint8_t* pBlock)
+		{
+			EncodeChannel(pTexels, 0, pBlock);
+		}
+
+		void DecodeBC4(const uint8_t* pBlock, uint32_t* pTexels)
+		{
+			uint32_t values[TexelsPerBlock];
+			DecodeChannel(pBlock, values);
+
+			for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+			{
+				pTexels[texelIdx] = MakeTexel(values[texelIdx], values[texelIdx], values[texelIdx], 255);
+			}
+		}
+
+		void EncodeBC5(const uint32_t* pTexels, uint8_t* pBlock)
+		{
+			EncodeChannel(pTexels, 0, pBlock);
+			EncodeChannel(pTexels, 1, pBlock + 8);
+		}
+
+		void DecodeBC5(const uint8_t* pBlock, uint32_t* pTexels)
+		{
+			uint32_t xValues[TexelsPerBlock];
+			uint32_t yValues[TexelsPerBlock];
+			DecodeChannel(pBlock, xValues);
+			DecodeChannel(pBlock + 8, yValues);
+
+			for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+			{
+				// Back to [-1, 1], z from the unit length, and z back to [0, 255] like the other two
+				const float x = static_cast<float>(xValues[texelIdx]) / 127.5f - 1.f;
+				const float y = static_cast<float>(yValues[texelIdx]) / 127.5f - 1.f;
+				const float z = std::sqrt(std::max(1.f - x * x - y * y, 0.f));
+
+				pTexels[texelIdx] = MakeTexel(xValues[texelIdx], yValues[texelIdx], static_cast<uint32_t>((z + 1.f) * 127.5f + .5f), 255);
+			}
+		}
+
+		void EncodeBC7(const uint32_t* pTexels, uint8_t* pBlock)
+		{
+			float endpoint0[4];
+			float endpoint1[4];
+			FitEndpoints(pTexels, 4, endpoint0, endpoint1);
+
+			uint32_t quantized0[4];
+			uint32_t quantized1[4];
+			uint32_t pBit0 = QuantizeBC7Endpoint(endpoint0, quantized0);
+			uint32_t pBit1 = QuantizeBC7Endpoint(endpoint1, quantized1);
+
+			uint32_t expanded0[4];
+			uint32_t expanded1[4];
+			for (int channel{ 0 }; channel < 4; ++channel)
+			{
+				expanded0[channel] = (quantized0[channel] << 1) | pBit0;
+				expanded1[channel] = (quantized1[channel] << 1) | pBit1;
+			}
+
+			uint32_t palette[16];
+			GetBC7Palette(expanded0, expanded1, palette);
+
+			uint32_t indices[TexelsPerBlock];
+			for (int texelIdx{ 0 }; texelIdx < TexelsPerBlock; ++texelIdx)
+			{
+				indices[texelIdx] = FindClosestEntry(pTexels[texelIdx], palette, 16, 4);
+			}
+
+			// The first index is stored without its top bit, so it has to be in the lower half of the palette
+			if (indices[0] >= 8)
+			{
+				std::swap(quantized0, quantized1);
+				std::swap(pBit0, pBit1);
+				for (uint32_t& index : indices)
+				{
+					index = 15 - index;
+				}
+			}
+
+			// Mode 6 is six 0 bits and a 1
+			BitWriter writer{};
+			writer.Write(1 << 6, 7);
+			for (int channel{ 0 }; channel < 4; ++channel)
+			{
+				writer.Write(quantized0[channel], 7);
+				writer.Write(quantized1[channel], 7);
+			}
+			writer.Write(pBit0, 1);
+			writer.Write(pBit1, 1);
+
+			writer.Write(indices[0], 3);
+			for (int texelIdx{ 1 }; texelIdx < TexelsPerBlock; ++texelIdx)
+			{
+				writer.Write(indices[texelIdx], 4);
+			}
+			writer.Store(pBlock);
+		}
+
+		void DecodeBC7(const uint8_t* pBlock, uint32_t* pTexels)
+		{
+			BitReader reader{ pBlock };
+			if (reader.Read(7) != 1 << 6)
+			{
+				std::fill(pTexels, pTexels + TexelsPerBlock, MakeTexel(255, 0, 255, 255));
+				return;
+			}
+
+			uint32_t endpoint0[4];
+			uint32_t endpoint1[4];
+			for (int channel{ 0 }; channel < 4; ++channel)
+			{
+				endpoint0[channel] = reader.Read(7) << 1;
+				endpoint1[channel] = reader.Read(7) << 1;
+			}
+
+			const uint32_t pBit0 = reader.Read(1);
+			const uint32_t pBit1 = reader.Read(1);
+			for (int channel{ 0 }; channel < 4; ++channel)
+			{
+				endpoint0[channel] |= pBit0;
+				endpoint1[channel] |= pBit1;
+			}
+
+			uint32_t palette[16];
+			GetBC7Palette(endpoint0, endpoint1, palette);
+
+			pTexels[0] = palette[reader.Read(3)];
+			for (int texelIdx{ 1 }; texelIdx < TexelsPerBlock; ++texelIdx)
+			{
+				pTexels[texelIdx] = palette[reader.Read(4)];
+			}
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+// Encoders and decoders for the block compressed texture formats, so the software rasterizer can sample the same blocks D3D gets.
+// A block is 4x4 texels, passed row by row as r, g, b, a bytes (dae::TextureFormat)
+namespace dae
+{
+	namespace BlockCompression
+	{
+		constexpr int BlockSize{ 4 };
+		constexpr int TexelsPerBlock{ BlockSize * BlockSize };
+
+		// 8 bytes: two RGB 565 endpoints and 2 bit indices, always encoded opaque
+		void EncodeBC1(const uint32_t* pTexels, uint8_t* pBlock);
+		void DecodeBC1(const uint8_t* pBlock, uint32_t* pTexels);
+
+		// 8 bytes: the red channel only, two 8 bit endpoints and 3 bit indices. Decodes to opaque gray
+		void EncodeBC4(const uint32_t* pTexels, uint8_t* pBlock);
+		void DecodeBC4(const uint8_t* pBlock, uint32_t* pTexels);
+
+		// 16 bytes: BC4 for red and for green. Meant for normal maps, blue is decoded as the z of the unit normal
+		void EncodeBC5(const uint32_t* pTexels, uint8_t* pBlock);
+		void DecodeBC5(const uint8_t* pBlock, uint32_t* pTexels);
+
+		// 16 bytes: mode 6 only, one subset with RGBA 7 bit + p-bit endpoints and 4 bit indices.
+		// Blocks in the other modes are never written by the encoder, they decode to opaque magenta
+		void EncodeBC7(const uint32_t* pTexels, uint8_t* pBlock);
+		void DecodeBC7(const uint8_t* pBlock, uint32_t* pTexels);
+	}
+}
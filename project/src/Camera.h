@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <cassert>
 #include <SDL_keyboard.h>
 #include <SDL_mouse.h>
@@ -39,6 +40,9 @@ namespace dae
 		Matrix viewMatrix{};
 		Matrix projectionMatrix{};
 
+		// World space, normals point inwards: left, right, bottom, top, near, far
+		std::array<Vector4, 6> frustumPlanes{};
+
 		void Initialize(float _fovAngle = 90.f, Vector3 _origin = {0.f,0.f,0.f},float AspectRatio = 9/3)
 		{
 			fovAngle = _fovAngle;
@@ -66,6 +70,31 @@ namespace dae
 			//DirectX Implementation => https://learn.microsoft.com/en-us/windows/win32/direct3d9/d3dxmatrixperspectivefovlh
 		}
 
+		// Gribb / Hartmann: with row vectors clip = p * viewProjection, so every plane is a sum of the matrix' columns.
+		// D3D clip space, so the near plane is z >= 0 instead of z >= -w
+		static std::array<Vector4, 6> ExtractFrustumPlanes(const Matrix& viewProjectionMatrix)
+		{
+			const auto column = [&viewProjectionMatrix](int idx)
+			{
+				return Vector4{ viewProjectionMatrix[0][idx], viewProjectionMatrix[1][idx], viewProjectionMatrix[2][idx], viewProjectionMatrix[3][idx] };
+			};
+
+			const Vector4 x = column(0);
+			const Vector4 y = column(1);
+			const Vector4 z = column(2);
+			const Vector4 w = column(3);
+
+			std::array<Vector4, 6> planes{ w + x, w - x, w + y, w - y, z, w - z };
+
+			// Normalized, so a plane's w plus the dot with a point is the signed distance to it
+			for (Vector4& plane : planes)
+			{
+				plane = plane / plane.GetXYZ().Magnitude();
+			}
+
+			return planes;
+		}
+
 		const float* GetOrigin() const
 		{
 			return reinterpret_cast<const float*>(&origin);
@@ -203,6 +232,7 @@ namespace dae
 			//Update Matrices
 			CalculateViewMatrix();
 			CalculateProjectionMatrix(); //Try to optimize this - should only be called once or when fov/aspectRatio changes
+			frustumPlanes = ExtractFrustumPlanes(viewMatrix * projectionMatrix);
 		}
 
 	};
@@ -9,7 +9,7 @@ Material::Material(const std::initializer_list<MatCompFormat>& materialInfo, ID3
 	for (const auto& matInfo : m_MaterialComponents)
 	{
 		matInfo.pMatCompTexture = new Texture();
-		matInfo.pMatCompTexture->LoadFromFile(directXDevice, matInfo.pMatCompPath);
+		matInfo.pMatCompTexture->LoadFromFile(directXDevice, matInfo.pMatCompPath, matInfo.matCompUsage);
 
 	}
 }
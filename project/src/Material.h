@@ -4,7 +4,7 @@
 #include <vector>
 #include "d3dx11effect.h"
 
-class Texture;
+#include "Texture.h"
 
 struct MatCompFormat
 {
@@ -12,16 +12,18 @@ struct MatCompFormat
 	const char* pMatCompPath;
 	mutable Texture* pMatCompTexture;
 	mutable ID3DX11EffectShaderResourceVariable* pMatCompEqDirectXResource;
+	// Picks how the texture is stored, maps that are only ever read through their red channel (gloss, specular) keep one channel
+	TextureUsage matCompUsage;
 
-	MatCompFormat(const char* matCompDirectXVarName, const char* matCompPath) :
+	MatCompFormat(const char* matCompDirectXVarName, const char* matCompPath, TextureUsage usage = TextureUsage::Color) :
 		pMatCompDirectXVarName{matCompDirectXVarName}, pMatCompPath{matCompPath}, pMatCompTexture(nullptr),
-		pMatCompEqDirectXResource(nullptr)
+		pMatCompEqDirectXResource(nullptr), matCompUsage{ usage }
 	{
 	}
 
 	MatCompFormat() :
 		pMatCompDirectXVarName{ nullptr }, pMatCompPath{ nullptr }, pMatCompTexture(nullptr),
-		pMatCompEqDirectXResource(nullptr)
+		pMatCompEqDirectXResource(nullptr), matCompUsage{ TextureUsage::Color }
 	{
 	}
 
@@ -1,5 +1,8 @@
 #include "Mesh.h"
+#include <algorithm>
 #include <cassert>
+#include <cfloat>
+#include <cmath>
 #include <cstdint>
 #include <d3d11.h>
 #include <iostream>
@@ -9,13 +12,28 @@
 
 #include "d3dx11effect.h"
 #include "Material.h"
+#include "Utils.h"
 
 
 Mesh::Mesh(ID3D11Device* pDevice, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, 
            BaseEffect* effect, std::initializer_list<MatCompFormat> materialComponents, bool usesTransparency)
 {
 	m_Vertices = vertices;
-	m_Indices = indices;
+	m_VertexStreams.Build(m_Vertices);
+	m_BoundingVolumes.Build(m_Vertices);
+	m_Lods.push_back(MeshLod{ indices });
+
+	// Transparent meshes are a few quads whose look comes from their texture: simplifying them only smears it,
+	// and meshlets would regroup their triangles where they need to keep their submission order
+	if (!usesTransparency)
+	{
+		BuildLods();
+
+		for (MeshLod& lod : m_Lods)
+		{
+			BuildMeshlets(lod);
+		}
+	}
 
 	m_pEffect = effect;
 
@@ -126,19 +144,21 @@ Mesh::Mesh(ID3D11Device* pDevice, const std::vector<Vertex>& vertices, const std
 		return;
 	}
 
-	// Create index buffer
-	m_NumIndices = static_cast<uint32_t>(indices.size());
-	bd.Usage = D3D11_USAGE_IMMUTABLE;
-	bd.ByteWidth = sizeof(uint32_t) * m_NumIndices;
-	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	bd.CPUAccessFlags = 0;
-	bd.MiscFlags = 0;
-	initData.pSysMem = indices.data();
-	result = pDevice->CreateBuffer(&bd,&initData,&m_pIndexBuffer);
-	if (FAILED(result))
+	// Create index buffer, one per LOD
+	for (MeshLod& lod : m_Lods)
 	{
-		std::cout << "failed to index Vertex Buffer" << std::endl;
-		return;
+		bd.Usage = D3D11_USAGE_IMMUTABLE;
+		bd.ByteWidth = sizeof(uint32_t) * static_cast<uint32_t>(lod.indices.size());
+		bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		bd.CPUAccessFlags = 0;
+		bd.MiscFlags = 0;
+		initData.pSysMem = lod.indices.data();
+		result = pDevice->CreateBuffer(&bd, &initData, &lod.pIndexBuffer);
+		if (FAILED(result))
+		{
+			std::cout << "failed to index Vertex Buffer" << std::endl;
+			return;
+		}
 	}
 
 	m_pEffect->SetMaterial(materialComponents, pDevice);
@@ -160,10 +180,13 @@ Mesh::~Mesh()
 		m_pVertexBuffer = nullptr;
 	}
 	
-	if (m_pIndexBuffer)
+	for (MeshLod& lod : m_Lods)
 	{
-		m_pIndexBuffer->Release();
-		m_pIndexBuffer = nullptr;
+		if (lod.pIndexBuffer)
+		{
+			lod.pIndexBuffer->Release();
+			lod.pIndexBuffer = nullptr;
+		}
 	}
 
 	if (m_pEffect)
@@ -173,8 +196,10 @@ Mesh::~Mesh()
 	}
 }
 
-void Mesh::Render(ID3D11DeviceContext* pDeviceContext, dae::Matrix& worldMatrix ,dae::Matrix& worldProjViewMatrix,const float* cameraPos) const
+void Mesh::Render(ID3D11DeviceContext* pDeviceContext, dae::Matrix& worldMatrix ,dae::Matrix& worldProjViewMatrix,const float* cameraPos, int lodIdx) const
 {
+	const MeshLod& lod = m_Lods[lodIdx];
+
 	// 0. Set Raster State
 	switch (m_CurrentCullMode)
 	{
@@ -205,7 +230,7 @@ void Mesh::Render(ID3D11DeviceContext* pDeviceContext, dae::Matrix& worldMatrix
 	pDeviceContext->IASetVertexBuffers(0, 1, &m_pVertexBuffer, &stride, &offset);
 
 	// 4. Set IndexBuffer
-	pDeviceContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	pDeviceContext->IASetIndexBuffer(lod.pIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
 	// 4B. Set Matrixes and Camera
 	m_pEffect->UpdateData(worldProjViewMatrix.GetData(),
@@ -219,7 +244,7 @@ void Mesh::Render(ID3D11DeviceContext* pDeviceContext, dae::Matrix& worldMatrix
 	for (UINT p = 0; p < techDesc.Passes; p++)
 	{
 		m_pEffect->GetTechnique()->GetPassByIndex(p)->Apply(0, pDeviceContext);
-		pDeviceContext->DrawIndexed(m_NumIndices, 0, 0);
+		pDeviceContext->DrawIndexed(static_cast<uint32_t>(lod.indices.size()), 0, 0);
 	}
 
 }
@@ -265,9 +290,9 @@ bool Mesh::HasMaterialByComponentName(const char* directXVarName) const
 	return m_pEffect->GetMaterial().DoesMaterialComponentExistByName(directXVarName);
 }
 
-std::vector<VertexOut>& Mesh::GetOutVertices()
+std::vector<VertexOut>& Mesh::GetOutVertices(int bufferIdx)
 {
-	return m_VerticesOut;
+	return m_VerticesOut[bufferIdx];
 }
 
 std::vector<Vertex>& Mesh::GetVertices()
@@ -275,9 +300,303 @@ std::vector<Vertex>& Mesh::GetVertices()
 	return m_Vertices;
 }
 
-std::vector<uint32_t>& Mesh::GetIndices()
+const VertexStreams& Mesh::GetVertexStreams() const
+{
+	return m_VertexStreams;
+}
+
+void VertexStreams::Build(const std::vector<Vertex>& vertices)
+{
+	const size_t paddedSize = (vertices.size() + Padding - 1) / Padding * Padding;
+
+	for (std::vector<float>* pStream : { &positionX, &positionY, &positionZ, &normalX, &normalY, &normalZ, &tangentX, &tangentY, &tangentZ })
+	{
+		pStream->assign(paddedSize, 0.f);
+	}
+
+	for (size_t idx = 0; idx < vertices.size(); idx++)
+	{
+		positionX[idx] = vertices[idx].Position.x;
+		positionY[idx] = vertices[idx].Position.y;
+		positionZ[idx] = vertices[idx].Position.z;
+		normalX[idx] = vertices[idx].Normal.x;
+		normalY[idx] = vertices[idx].Normal.y;
+		normalZ[idx] = vertices[idx].Normal.z;
+		tangentX[idx] = vertices[idx].Tangent.x;
+		tangentY[idx] = vertices[idx].Tangent.y;
+		tangentZ[idx] = vertices[idx].Tangent.z;
+	}
+}
+
+const BoundingVolumes& Mesh::GetBoundingVolumes() const
+{
+	return m_BoundingVolumes;
+}
+
+void BoundingVolumes::Build(const std::vector<Vertex>& vertices)
+{
+	if (vertices.empty()) return;
+
+	boxMin = vertices[0].Position;
+	boxMax = vertices[0].Position;
+
+	for (const Vertex& vertex : vertices)
+	{
+		for (int axis{ 0 }; axis < 3; axis++)
+		{
+			boxMin[axis] = std::min(boxMin[axis], vertex.Position[axis]);
+			boxMax[axis] = std::max(boxMax[axis], vertex.Position[axis]);
+		}
+	}
+
+	// Centered on the box, not the smallest possible sphere but close enough for culling
+	sphereCenter = (boxMin + boxMax) * .5f;
+	sphereRadius = 0.f;
+
+	for (const Vertex& vertex : vertices)
+	{
+		sphereRadius = std::max(sphereRadius, (vertex.Position - sphereCenter).Magnitude());
+	}
+}
+
+bool BoundingVolumes::IsInFrustum(const std::array<dae::Vector4, 6>& frustumPlanes, const dae::Matrix& worldMatrix) const
+{
+	// Non uniform scale stretches the sphere, the longest axis keeps it conservative
+	const float scale = std::max(worldMatrix.GetAxisX().Magnitude(), std::max(worldMatrix.GetAxisY().Magnitude(), worldMatrix.GetAxisZ().Magnitude()));
+	const dae::Vector3 worldSphereCenter = worldMatrix.TransformPoint(sphereCenter);
+	const float worldSphereRadius = sphereRadius * scale;
+
+	for (const dae::Vector4& plane : frustumPlanes)
+	{
+		if (dae::Vector3::Dot(plane.GetXYZ(), worldSphereCenter) + plane.w < -worldSphereRadius) return false;
+	}
+
+	// World space box around the transformed box: every world axis gets the absolute contribution of the three local extents
+	const dae::Vector3 worldBoxCenter = worldMatrix.TransformPoint((boxMin + boxMax) * .5f);
+	const dae::Vector3 extents = (boxMax - boxMin) * .5f;
+	dae::Vector3 worldExtents{};
+
+	for (int axis{ 0 }; axis < 3; axis++)
+	{
+		worldExtents[axis] = std::abs(worldMatrix[0][axis]) * extents.x + std::abs(worldMatrix[1][axis]) * extents.y + std::abs(worldMatrix[2][axis]) * extents.z;
+	}
+
+	for (const dae::Vector4& plane : frustumPlanes)
+	{
+		const float projectedRadius = std::abs(plane.x) * worldExtents.x + std::abs(plane.y) * worldExtents.y + std::abs(plane.z) * worldExtents.z;
+		if (dae::Vector3::Dot(plane.GetXYZ(), worldBoxCenter) + plane.w < -projectedRadius) return false;
+	}
+
+	return true;
+}
+
+const std::vector<Meshlet>& Mesh::GetMeshlets(int lodIdx) const
+{
+	return m_Lods[lodIdx].meshlets;
+}
+
+MeshletVisibility& Mesh::GetMeshletVisibility(int bufferIdx)
+{
+	return m_MeshletVisibility[bufferIdx];
+}
+
+void Mesh::BuildLods()
+{
+	const std::vector<uint32_t>& indices = m_Lods[0].indices;
+
+	// Every level is simplified from the full mesh, so errors do not pile up along the chain
+	for (int lodIdx{ 1 }; lodIdx < MaxLods; lodIdx++)
+	{
+		MeshLod lod{};
+		dae::Utils::SimplifyMesh(m_Vertices, indices, (indices.size() >> lodIdx) / 3 * 3, lod.indices);
+
+		// Locked borders and seams keep the simplification from getting much further, the rest of the chain would repeat this level
+		if (lod.indices.size() * 4 > m_Lods.back().indices.size() * 3) break;
+
+		m_Lods.push_back(std::move(lod));
+	}
+
+	const size_t nrOfBlocks = (m_Vertices.size() + VertexStreams::Padding - 1) / VertexStreams::Padding;
+	for (MeshLod& lod : m_Lods)
+	{
+		lod.vertexBlocks.assign(nrOfBlocks, 0);
+		for (const uint32_t index : lod.indices)
+		{
+			lod.vertexBlocks[index / VertexStreams::Padding] = 1;
+		}
+	}
+}
+
+void Mesh::BuildMeshlets(MeshLod& lod) const
+{
+	std::vector<uint32_t>& indices = lod.indices;
+	const uint32_t nrOfTriangles = static_cast<uint32_t>(indices.size() / 3);
+
+	// Unit normal per triangle (zero if degenerate), same winding the rasterizer culls with:
+	// back facing when the normal points away from the camera
+	std::vector<dae::Vector3> triangleNormals(nrOfTriangles);
+	std::vector<std::vector<uint32_t>> vertexTriangles(m_Vertices.size());
+
+	for (uint32_t triangleIdx{ 0 }; triangleIdx < nrOfTriangles; triangleIdx++)
+	{
+		const uint32_t* pTriangle = &indices[triangleIdx * 3];
+		const dae::Vector3& p0 = m_Vertices[pTriangle[0]].Position;
+		const dae::Vector3 normal = dae::Vector3::Cross(m_Vertices[pTriangle[1]].Position - p0, m_Vertices[pTriangle[2]].Position - p0);
+		if (normal.SqrMagnitude() > 0.f) triangleNormals[triangleIdx] = normal.Normalized();
+
+		for (int idx{ 0 }; idx < 3; idx++)
+		{
+			vertexTriangles[pTriangle[idx]].push_back(triangleIdx);
+		}
+	}
+
+	std::vector<bool> isTriangleUsed(nrOfTriangles);
+	// Reset after every meshlet from its vertex and candidate lists, so building one only costs what it touches
+	std::vector<bool> isVertexInMeshlet(m_Vertices.size());
+	std::vector<bool> isCandidate(nrOfTriangles);
+	std::vector<uint32_t> meshletIndices{};
+	meshletIndices.reserve(indices.size());
+
+	uint32_t seedTriangle{ 0 };
+	while (true)
+	{
+		while (seedTriangle < nrOfTriangles && isTriangleUsed[seedTriangle]) seedTriangle++;
+		if (seedTriangle == nrOfTriangles) break;
+
+		Meshlet meshlet{};
+		meshlet.firstTriangle = static_cast<uint32_t>(meshletIndices.size() / 3);
+		dae::Vector3 normalSum{};
+		std::vector<uint32_t> meshletTriangles{};
+		// Unused triangles sharing a vertex with the meshlet, in the order their vertices joined it
+		std::vector<uint32_t> candidates{};
+
+		const auto countNewVertices = [&](uint32_t triangleIdx)
+		{
+			const uint32_t* pTriangle = &indices[triangleIdx * 3];
+
+			int nrOfNewVertices{ 0 };
+			for (int idx{ 0 }; idx < 3; idx++)
+			{
+				if (std::find(pTriangle, pTriangle + idx, pTriangle[idx]) != pTriangle + idx) continue;
+				if (!isVertexInMeshlet[pTriangle[idx]]) nrOfNewVertices++;
+			}
+			return nrOfNewVertices;
+		};
+
+		// Grows over shared vertices: first the triangle that adds the fewest vertices, then the one closest to the meshlet's
+		// average normal, which keeps the normal cone narrow enough to cull
+		uint32_t triangleIdx{ seedTriangle };
+		while (true)
+		{
+			isTriangleUsed[triangleIdx] = true;
+			normalSum += triangleNormals[triangleIdx];
+			meshletTriangles.push_back(triangleIdx);
+			meshlet.nrOfTriangles++;
+
+			for (int idx{ 0 }; idx < 3; idx++)
+			{
+				const uint32_t vertexIdx = indices[triangleIdx * 3 + idx];
+				meshletIndices.push_back(vertexIdx);
+				if (isVertexInMeshlet[vertexIdx]) continue;
+
+				isVertexInMeshlet[vertexIdx] = true;
+				meshlet.vertices.push_back(vertexIdx);
+
+				for (uint32_t candidate : vertexTriangles[vertexIdx])
+				{
+					if (isTriangleUsed[candidate] || isCandidate[candidate]) continue;
+
+					isCandidate[candidate] = true;
+					candidates.push_back(candidate);
+				}
+			}
+
+			if (meshlet.nrOfTriangles == Meshlet::MaxTriangles) break;
+
+			// Erase keeps the order, so ties go to the same triangle as when walking the meshlet's vertices
+			std::erase_if(candidates, [&](uint32_t candidate) { return isTriangleUsed[candidate]; });
+
+			uint32_t bestTriangle{ nrOfTriangles };
+			int bestNewVertices{ 4 };
+			float bestAlignment{ -FLT_MAX };
+
+			for (uint32_t candidate : candidates)
+			{
+				const int nrOfNewVertices = countNewVertices(candidate);
+				if (meshlet.vertices.size() + nrOfNewVertices > Meshlet::MaxVertices) continue;
+
+				const float alignment = dae::Vector3::Dot(triangleNormals[candidate], normalSum);
+				if (nrOfNewVertices < bestNewVertices || (nrOfNewVertices == bestNewVertices && alignment > bestAlignment))
+				{
+					bestTriangle = candidate;
+					bestNewVertices = nrOfNewVertices;
+					bestAlignment = alignment;
+				}
+			}
+
+			if (bestTriangle == nrOfTriangles) break;
+			triangleIdx = bestTriangle;
+		}
+
+		for (uint32_t vertexIdx : meshlet.vertices) isVertexInMeshlet[vertexIdx] = false;
+		for (uint32_t candidate : candidates) isCandidate[candidate] = false;
+
+		dae::Vector3 boxMin = m_Vertices[meshlet.vertices[0]].Position;
+		dae::Vector3 boxMax = boxMin;
+
+		for (uint32_t vertexIdx : meshlet.vertices)
+		{
+			for (int axis{ 0 }; axis < 3; axis++)
+			{
+				boxMin[axis] = std::min(boxMin[axis], m_Vertices[vertexIdx].Position[axis]);
+				boxMax[axis] = std::max(boxMax[axis], m_Vertices[vertexIdx].Position[axis]);
+			}
+		}
+
+		meshlet.sphereCenter = (boxMin + boxMax) * .5f;
+		for (uint32_t vertexIdx : meshlet.vertices)
+		{
+			meshlet.sphereRadius = std::max(meshlet.sphereRadius, (m_Vertices[vertexIdx].Position - meshlet.sphereCenter).Magnitude());
+		}
+
+		if (normalSum.Magnitude() > 1e-4f)
+		{
+			meshlet.coneAxis = normalSum.Normalized();
+
+			float minDot{ 1.f };
+			for (uint32_t meshletTriangle : meshletTriangles)
+			{
+				// Degenerate triangles are never drawn, their zero normal does not widen the cone
+				if (triangleNormals[meshletTriangle].SqrMagnitude() > 0.f)
+				{
+					minDot = std::min(minDot, dae::Vector3::Dot(meshlet.coneAxis, triangleNormals[meshletTriangle]));
+				}
+			}
+
+			meshlet.hasNormalCone = minDot > 0.f;
+			meshlet.coneCutoff = std::sqrt(std::max(1.f - minDot * minDot, 0.f));
+		}
+
+		lod.meshlets.push_back(std::move(meshlet));
+	}
+
+	// Triangles are regrouped per meshlet, so every meshlet is a contiguous range of the index buffer
+	indices = std::move(meshletIndices);
+}
+
+std::vector<uint32_t>& Mesh::GetIndices(int lodIdx)
+{
+	return m_Lods[lodIdx].indices;
+}
+
+const std::vector<uint8_t>& Mesh::GetLodVertexBlocks(int lodIdx) const
+{
+	return m_Lods[lodIdx].vertexBlocks;
+}
+
+int Mesh::GetNrOfLods() const
 {
-	return m_Indices;
+	return static_cast<int>(m_Lods.size());
 }
 
 void Mesh::ToggleCullMode()
@@ -1,4 +1,6 @@
 #pragma once
+#include <array>
+#include <cstdint>
 #include <d3d11.h>
 #include <vector>
 
@@ -19,6 +21,98 @@ struct Vertex
 	dae::Vector4 WorldPosition{};
 };
 
+// Which clip planes a vertex is outside of, computed once per vertex in homogeneous clip space
+enum Outcodes : uint16_t
+{
+	OutcodeLeft = 1 << 0,
+	OutcodeRight = 1 << 1,
+	OutcodeBottom = 1 << 2,
+	OutcodeTop = 1 << 3,
+	OutcodeNear = 1 << 4,
+	OutcodeFar = 1 << 5,
+	OutcodeFrustum = OutcodeLeft | OutcodeRight | OutcodeBottom | OutcodeTop | OutcodeNear | OutcodeFar,
+
+	OutcodeGuardBandLeft = 1 << 6,
+	OutcodeGuardBandRight = 1 << 7,
+	OutcodeGuardBandBottom = 1 << 8,
+	OutcodeGuardBandTop = 1 << 9,
+	OutcodeGuardBand = OutcodeGuardBandLeft | OutcodeGuardBandRight | OutcodeGuardBandBottom | OutcodeGuardBandTop
+};
+
+// Structure of arrays copy of what the software vertex stage transforms, so it can load several vertices at once.
+// Padded with zeros to a multiple of Padding vertices, so the SIMD loop never needs a scalar tail
+struct VertexStreams
+{
+	static constexpr int Padding{ 8 };
+
+	std::vector<float> positionX{};
+	std::vector<float> positionY{};
+	std::vector<float> positionZ{};
+	std::vector<float> normalX{};
+	std::vector<float> normalY{};
+	std::vector<float> normalZ{};
+	std::vector<float> tangentX{};
+	std::vector<float> tangentY{};
+	std::vector<float> tangentZ{};
+
+	void Build(const std::vector<Vertex>& vertices);
+};
+
+// Object space bounds, computed once at load time so whole meshes can be culled before any per vertex work
+struct BoundingVolumes
+{
+	dae::Vector3 sphereCenter{};
+	float sphereRadius{};
+	dae::Vector3 boxMin{};
+	dae::Vector3 boxMax{};
+
+	void Build(const std::vector<Vertex>& vertices);
+
+	// False if the mesh is completely behind one of the (world space) frustum planes,
+	// the sphere is tested first and the tighter box only when the sphere intersects
+	bool IsInFrustum(const std::array<dae::Vector4, 6>& frustumPlanes, const dae::Matrix& worldMatrix) const;
+};
+
+// Cluster of up to MaxVertices vertices and MaxTriangles triangles, its triangles are contiguous in the index buffer.
+// The software path culls whole meshlets against the frustum (sphere) and for back faces (normal cone)
+struct Meshlet
+{
+	static constexpr int MaxVertices{ 64 };
+	static constexpr int MaxTriangles{ 124 };
+
+	uint32_t firstTriangle{};
+	uint32_t nrOfTriangles{};
+	// Every vertex index used by the meshlet once
+	std::vector<uint32_t> vertices{};
+
+	dae::Vector3 sphereCenter{};
+	float sphereRadius{};
+
+	// All triangle normals are within coneCutoff (sine of the half angle) of coneAxis.
+	// A cone of 90 degrees or wider faces the camera from anywhere, those meshlets are never back face culled
+	dae::Vector3 coneAxis{};
+	float coneCutoff{};
+	bool hasNormalCone{};
+};
+
+// Result of culling the meshlets for one frame: the visible meshlets
+// and, per VertexStreams::Padding vertices, whether one of those uses them
+struct MeshletVisibility
+{
+	std::vector<uint32_t> meshlets{};
+	std::vector<uint8_t> vertexBlocks{};
+};
+
+// One level of detail: its own triangles over the mesh's shared vertex buffer
+struct MeshLod
+{
+	std::vector<uint32_t> indices{};
+	std::vector<Meshlet> meshlets{};
+	// Per VertexStreams::Padding vertices, whether a triangle of this level uses them
+	std::vector<uint8_t> vertexBlocks{};
+	ID3D11Buffer* pIndexBuffer{ nullptr };
+};
+
 struct VertexOut
 {
 	dae::Vector4 Position{};
@@ -27,6 +121,8 @@ struct VertexOut
 	dae::Vector3 Normal{};
 	dae::Vector3 Tangent{};
 	dae::Vector4 WorldPosition{};
+	dae::Vector4 ClipPosition{};
+	uint16_t Outcode{};
 };
 
 enum PrimitiveTopology
@@ -57,7 +153,10 @@ public:
 	Mesh& operator=(const Mesh&) = delete;
 	Mesh& operator=(Mesh&&) noexcept = delete;
 
-	void Render(ID3D11DeviceContext* pDeviceContext, dae::Matrix& worldMatrix, dae::Matrix& worldProjViewMatrix, const float* cameraPos) const;
+	// LOD 0 is the mesh as loaded, every next level has about half the triangles
+	static constexpr int MaxLods{ 5 };
+
+	void Render(ID3D11DeviceContext* pDeviceContext, dae::Matrix& worldMatrix, dae::Matrix& worldProjViewMatrix, const float* cameraPos, int lodIdx) const;
 	void ToggleTechnique() const;
 	PrimitiveTopology GetPrimitiveTopology() const;
 	void SetPrimitiveTopology(const PrimitiveTopology& primitiveTopologyType);
@@ -66,9 +165,15 @@ public:
 	void SetWorldMatrix(const dae::Matrix& newMatrix);
 	MatCompFormat& GetMaterialComponentByName(const char* directXVarName) const;
 	bool HasMaterialByComponentName(const char* directXVarName) const;
-	std::vector<VertexOut>& GetOutVertices();
+	std::vector<VertexOut>& GetOutVertices(int bufferIdx);
 	std::vector<Vertex>& GetVertices();
-	std::vector<uint32_t>& GetIndices();
+	const VertexStreams& GetVertexStreams() const;
+	const BoundingVolumes& GetBoundingVolumes() const;
+	const std::vector<Meshlet>& GetMeshlets(int lodIdx) const;
+	MeshletVisibility& GetMeshletVisibility(int bufferIdx);
+	std::vector<uint32_t>& GetIndices(int lodIdx);
+	const std::vector<uint8_t>& GetLodVertexBlocks(int lodIdx) const;
+	int GetNrOfLods() const;
 	void ToggleCullMode();
 	CullModes& GetCurrentCullMode();
 	const char* GetCurrentCullModeName() const;
@@ -77,12 +182,15 @@ public:
 
 private:
 	ID3D11InputLayout*		m_pInputLayout{ nullptr };
-	uint32_t				m_NumIndices{};
 	ID3D11Buffer*			m_pVertexBuffer{ nullptr };
 	std::vector<Vertex>		m_Vertices{};
-	std::vector<VertexOut>	m_VerticesOut{};
-	ID3D11Buffer*			m_pIndexBuffer{ nullptr };
-	std::vector<uint32_t>	m_Indices{};
+	VertexStreams			m_VertexStreams{};
+	BoundingVolumes			m_BoundingVolumes{};
+	std::vector<MeshLod>	m_Lods{};
+	// Double buffered like m_VerticesOut
+	std::array<MeshletVisibility, 2> m_MeshletVisibility{};
+	// Double buffered, so the next frame can be transformed while the current one is rasterized
+	std::array<std::vector<VertexOut>, 2> m_VerticesOut{};
 	BaseEffect*				m_pEffect { nullptr };
 	PrimitiveTopology       m_PrimitiveTopology{ TriangleList };
 	CullModes               m_CurrentCullMode{BackFaceCull};
@@ -91,6 +199,9 @@ private:
 
 	dae::Matrix				m_WorldMatrix{ };
 
+	void BuildLods();
+	void BuildMeshlets(MeshLod& lod) const;
+
 	ID3D11RasterizerState* m_pCullingFront;
 	ID3D11RasterizerState* m_pCullingBack;
 	ID3D11RasterizerState* m_pCullingNone;
@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+#include "ColorRGBA.h"
+#include "SDL_pixels.h"
+
+// Pack / unpack routines for the two pixel formats the software rasterizer uses,
+// so the inner loops never have to go through SDL_MapRGB / SDL_GetRGBA
+namespace dae
+{
+	// Back buffer: 0xAARRGGBB, alpha is always 255
+	constexpr SDL_PixelFormatEnum BackBufferFormat{ SDL_PIXELFORMAT_ARGB8888 };
+
+	// Textures are converted to this on load: r, g, b, a bytes in memory
+	constexpr SDL_PixelFormatEnum TextureFormat{ SDL_PIXELFORMAT_RGBA32 };
+
+	// Like MaxToOne followed by SDL_MapRGB: keeps the hue when a channel goes over 1, channels are truncated to 8 bit
+	inline uint32_t PackPixel(const ColorRGBA& color)
+	{
+		const float scale = 255.f / std::max(std::max(color.r, std::max(color.g, color.b)), 1.f);
+
+		return 0xFF000000
+			| (static_cast<uint32_t>(std::max(color.r * scale, 0.f)) << 16)
+			| (static_cast<uint32_t>(std::max(color.g * scale, 0.f)) << 8)
+			| static_cast<uint32_t>(std::max(color.b * scale, 0.f));
+	}
+
+	inline ColorRGBA UnpackPixel(uint32_t pixel)
+	{
+		return {
+			((pixel >> 16) & 0xFF) / 255.f,
+			((pixel >> 8) & 0xFF) / 255.f,
+			(pixel & 0xFF) / 255.f,
+			1.f
+		};
+	}
+
+	inline ColorRGBA UnpackTexel(uint32_t texel)
+	{
+		return {
+			(texel & 0xFF) / 255.f,
+			((texel >> 8) & 0xFF) / 255.f,
+			((texel >> 16) & 0xFF) / 255.f,
+			(texel >> 24) / 255.f
+		};
+	}
+
+	// Single channel textures only keep the red byte, it is put back in r, g and b
+	inline ColorRGBA UnpackSingleChannelTexel(uint8_t texel)
+	{
+		const float value = texel / 255.f;
+		return { value, value, value, 1.f };
+	}
+
+	// Whole rows at once, no branches so the compiler can vectorize them
+	inline void PackPixels(const ColorRGBA* pColors, uint32_t* pPixels, int nrOfPixels)
+	{
+		for (int idx{ 0 }; idx < nrOfPixels; idx++)
+		{
+			pPixels[idx] = PackPixel(pColors[idx]);
+		}
+	}
+
+	inline void UnpackPixels(const uint32_t* pPixels, ColorRGBA* pColors, int nrOfPixels)
+	{
+		for (int idx{ 0 }; idx < nrOfPixels; idx++)
+		{
+			pColors[idx] = UnpackPixel(pPixels[idx]);
+		}
+	}
+}
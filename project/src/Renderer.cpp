@@ -1,10 +1,15 @@
 #include "pch.h"
 #include "Renderer.h"
 #include <array>
+#include <bit>
+#include <cstring>
 #include <numeric>
+#include <random>
 
 #include "AlphaEffect.h"
 #include "Material.h"
+#include "Pixel.h"
+#include "Simd.h"
 #include "Utils.h"
 
 #define ESC "\033["
@@ -16,6 +21,67 @@
 
 namespace dae {
 
+	namespace
+	{
+		// Counted per raster thread and added to the frame stats once per region, so pixels don't fight over an atomic
+		thread_local uint64_t t_VisibilityFragments{};
+		thread_local uint64_t t_ShadedPixels{};
+		thread_local uint64_t t_SampleTaps{};
+
+		// Adds this thread's counters to the frame stats and resets them, called at the end of every region
+		void FlushThreadCounters(SoftwareFrameStats& frameStats)
+		{
+			frameStats.visibilityFragments.fetch_add(t_VisibilityFragments, std::memory_order_relaxed);
+			frameStats.shadedPixels.fetch_add(t_ShadedPixels, std::memory_order_relaxed);
+			frameStats.sampleTaps.fetch_add(t_SampleTaps, std::memory_order_relaxed);
+			t_VisibilityFragments = 0;
+			t_ShadedPixels = 0;
+			t_SampleTaps = 0;
+		}
+
+		// Deferred shading resolves a row of the region at a time
+		thread_local std::vector<ColorRGBA> t_RowColors{};
+
+		// Stable LSD radix sort on the 16 bit key in bits 32 - 47 of every item, one pass per byte.
+		// Both histograms are counted in a single read of the items
+		void RadixSortByKey(std::vector<uint64_t>& items, std::vector<uint64_t>& scratch)
+		{
+			constexpr int nrOfPasses{ 2 };
+			constexpr int firstKeyBit{ 32 };
+
+			std::array<std::array<uint32_t, 256>, nrOfPasses> offsets{};
+			for (const uint64_t item : items)
+			{
+				for (int pass{ 0 }; pass < nrOfPasses; pass++)
+				{
+					++offsets[pass][(item >> (firstKeyBit + pass * 8)) & 0xFF];
+				}
+			}
+
+			scratch.resize(items.size());
+
+			for (int pass{ 0 }; pass < nrOfPasses; pass++)
+			{
+				// Counts to start offsets
+				uint32_t total{};
+				for (uint32_t& offset : offsets[pass])
+				{
+					const uint32_t count = offset;
+					offset = total;
+					total += count;
+				}
+
+				const int shift{ firstKeyBit + pass * 8 };
+				for (const uint64_t item : items)
+				{
+					scratch[offsets[pass][(item >> shift) & 0xFF]++] = item;
+				}
+
+				items.swap(scratch);
+			}
+		}
+	}
+
 	Renderer::Renderer(SDL_Window* pWindow) :
 		m_pWindow(pWindow)
 	{
@@ -36,11 +102,24 @@ namespace dae {
 
 		//Create Buffers
 		m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
-		m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
+		// Fixed ARGB8888 so pixels can be packed directly, the alpha byte is always 255 and not blended when presenting
+		m_pBackBuffer = SDL_CreateRGBSurfaceWithFormat(0, m_Width, m_Height, 32, BackBufferFormat);
+		SDL_SetSurfaceBlendMode(m_pBackBuffer, SDL_BLENDMODE_NONE);
 		m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
 
 		m_pDepthBufferPixels = new float[m_Width * m_Height];
 
+		m_NrOfTilesX = (m_Width + TileSize - 1) / TileSize;
+		m_NrOfTilesY = (m_Height + TileSize - 1) / TileSize;
+		m_TileBins.resize(m_NrOfTilesX * m_NrOfTilesY);
+		m_TileClearFrames.resize(m_TileBins.size(), 0);
+		m_TileFillColors.resize(m_TileBins.size(), 0);
+
+		m_NrOfHiZBlocksX = (m_Width + SmallBlockSize - 1) / SmallBlockSize;
+		m_NrOfHiZBlocksY = (m_Height + SmallBlockSize - 1) / SmallBlockSize;
+		m_pHiZBlockDepths = new float[m_NrOfHiZBlocksX * m_NrOfHiZBlocksY];
+		m_pHiZTileDepths = new float[m_NrOfTilesX * m_NrOfTilesY];
+
 		m_AspectRatio = float(m_Width) / m_Height;
 
 
@@ -54,16 +133,16 @@ namespace dae {
 
 		m_MeshEffects["FireEffect"] = new AlphaEffect(m_pDevice, L"Resources/PosColorAlpha.fx");
 
-		Utils::ParseOBJ("Resources/vehicle.obj", vertices, indices,false);
+		Utils::ParseOBJ("Resources/vehicle.obj", vertices, indices, false, true);
 
 		m_pMeshes.push_back(new Mesh
 			{ m_pDevice,vertices,indices,m_MeshEffects["VehicleEffect"],
 			{ MatCompFormat("gDiffuseMap", "Resources/vehicle_diffuse.png"),
-			MatCompFormat("gNormalMap","Resources/vehicle_normal.png"),
-			MatCompFormat("gSpecularMap","Resources/vehicle_specular.png"),
-			MatCompFormat("gGlossinessMap","Resources/vehicle_gloss.png") } });
+			MatCompFormat("gNormalMap","Resources/vehicle_normal.png", TextureUsage::Normal),
+			MatCompFormat("gSpecularMap","Resources/vehicle_specular.png", TextureUsage::SingleChannel),
+			MatCompFormat("gGlossinessMap","Resources/vehicle_gloss.png", TextureUsage::SingleChannel) } });
 
-	 	Utils::ParseOBJ("Resources/fireFX.obj", vertices, indices, false);
+	 	Utils::ParseOBJ("Resources/fireFX.obj", vertices, indices, false, true);
 	 
 	 	m_pMeshes.push_back(new Mesh
 	 		{ m_pDevice,vertices,indices,m_MeshEffects["FireEffect"],
@@ -74,9 +153,16 @@ namespace dae {
 		{
 			mesh->SetWorldMatrix(Matrix::CreateTranslation(0,0,50));
 		}
+		m_MeshLods.resize(m_pMeshes.size(), 0);
 		m_DepthBuffer.resize(m_Width * m_Height, FLT_MAX);
 
-		m_ClosestTriangle.resize(m_DepthBuffer.size());
+		m_ClosestTriangle.resize(m_DepthBuffer.size(), -1);
+
+		for (auto& accumulation : m_TransparentAccumulation)
+		{
+			accumulation.resize(m_DepthBuffer.size(), 0.f);
+		}
+		m_TransparentRevealage.resize(m_DepthBuffer.size(), 1.f);
 
 		m_Camera.Initialize(45.f, { .0f,.0f,0.f }, m_AspectRatio);
 
@@ -84,6 +170,9 @@ namespace dae {
 
 	Renderer::~Renderer()
 	{
+		// The vertex stage could still be writing to the meshes
+		if (m_PendingTransform.valid()) m_PendingTransform.wait();
+
 		if (m_pDeviceContext) m_pDeviceContext->Release();
 		if (m_pDevice) m_pDevice->Release();
 		if (m_pSwapChain) m_pSwapChain->Release();
@@ -93,6 +182,8 @@ namespace dae {
 		if (m_pRenderTargetView) m_pRenderTargetView->Release();
 
 		delete[] m_pDepthBufferPixels;
+		delete[] m_pHiZBlockDepths;
+		delete[] m_pHiZTileDepths;
 
 		for (const auto mesh : m_pMeshes)
 		{
@@ -111,61 +202,120 @@ namespace dae {
 			}
 			
 		}
-		
+
+		SelectLods();
+	}
+
+	void Renderer::SelectLods()
+	{
+		for (size_t meshIdx{ 0 }; meshIdx < m_pMeshes.size(); meshIdx++)
+		{
+			Mesh* currentMesh = m_pMeshes[meshIdx];
+			int& currentLod = m_MeshLods[meshIdx];
+
+			if (!m_IsLodSelection)
+			{
+				currentLod = 0;
+				continue;
+			}
+
+			const Matrix worldMatrix = currentMesh->GetWorldMatrix();
+			const BoundingVolumes& boundingVolumes = currentMesh->GetBoundingVolumes();
+			const float scale = std::max(worldMatrix.GetAxisX().Magnitude(), std::max(worldMatrix.GetAxisY().Magnitude(), worldMatrix.GetAxisZ().Magnitude()));
+			const float radius = boundingVolumes.sphereRadius * scale;
+			const float distance = (worldMatrix.TransformPoint(boundingVolumes.sphereCenter) - m_Camera.origin).Magnitude();
+
+			// Projected height of the bounding sphere in pixels, from inside the sphere the mesh always gets its full detail
+			const float screenSize = distance > radius ? radius / (distance * m_Camera.FOV) * m_Height : FLT_MAX;
+
+			const int maxLod = std::min(currentMesh->GetNrOfLods() - 1, static_cast<int>(m_LodScreenSizes.size()));
+			int lod{ 0 };
+			while (lod < maxLod && screenSize < m_LodScreenSizes[lod]) lod++;
+
+			while (lod > currentLod && screenSize >= m_LodScreenSizes[lod - 1] * (1.f - m_LodHysteresis)) lod--;
+			while (lod < currentLod && screenSize < m_LodScreenSizes[lod] * (1.f + m_LodHysteresis)) lod++;
+
+			currentLod = lod;
+		}
 	}
 
 
 	
 
-	void Renderer::Render() const
+	void Renderer::Render()
+	{
+		if (m_IsSoftwareRasterizer)
+		{
+			RenderSoftware();
+		}
+
+		else
+		{
+			RenderHardware();
+		}
+	}
+
+	void Renderer::RenderSoftware()
 	{
 		ColorRGBA backgroundColor{ .1f, .1f, .1f };
 
-		if (m_IsSoftwareRasterizer)
+		//@START
+		//Lock BackBuffer
+		if (m_UniformColor == false)
 		{
-			//@START
-			//Lock BackBuffer
-			if (m_UniformColor == false)
-			{
-				backgroundColor = { 0.39,0.39 ,0.39 };
-			}
-	
-			SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format,
-				static_cast<uint8_t>(backgroundColor.r * 255),
-				static_cast<uint8_t>(backgroundColor.g * 255),
-				static_cast<uint8_t>(backgroundColor.b * 255)));
-			SDL_LockSurface(m_pBackBuffer);
+			backgroundColor = { 0.39,0.39 ,0.39 };
+		}
 
-			for (int idx{}; idx < m_Width * m_Height; idx++)
-			{
-				m_pDepthBufferPixels[idx] = FLT_MAX;
-			}
+		SDL_LockSurface(m_pBackBuffer);
 
-			for (auto currentMesh: m_pMeshes)
-			{
-				if (currentMesh == m_pMeshes[1] && m_RenderFireMesh == false) continue;
+		// Nothing is cleared here, tiles clear their color and depth when geometry first touches them (ClearTile)
+		// and the untouched ones get the clear color right before presenting (FillUntouchedTiles)
+		m_ClearColor = PackPixel(backgroundColor);
+		++m_FrameNumber;
 
+		m_RasterTriangles.clear();
 
-				auto& verticesOut = currentMesh->GetOutVertices();
-				auto&  indices = currentMesh->GetIndices();
-				VertexTransformationFunction(currentMesh->GetVertices(),
-					verticesOut, *currentMesh);
+		// Halve the anisotropy after a frame over the tap budget and double it again once that still fits.
+		// It only changes between frames, so the image does not depend on which thread shades a fragment first
+		const uint64_t previousSampleTaps = m_FrameStats.sampleTaps;
+		if (previousSampleTaps > m_SampleTapBudget) m_FrameAnisotropy = std::max(m_FrameAnisotropy / 2, 1);
+		else if (previousSampleTaps * 2 <= m_SampleTapBudget) m_FrameAnisotropy *= 2;
+		m_FrameAnisotropy = std::min(m_FrameAnisotropy, m_MaxAnisotropy);
 
-				int nrOfTriangles;
+		m_FrameStats.Reset();
 
-				if (currentMesh->GetPrimitiveTopology() == TriangleList)
-				{
-					nrOfTriangles = indices.size() / 3;
-				}
+		const int rasterBuffer = PrepareVertices();
+		const FrameSnapshot& snapshot = m_FrameSnapshots[rasterBuffer];
+		m_ShadingCameraOrigin = snapshot.cameraOrigin;
 
-				else
-				{
-					nrOfTriangles = indices.size() - 2;
-				}
+		for (size_t meshIdx{ 0 }; meshIdx < m_pMeshes.size(); meshIdx++)
+		{
+			if (!snapshot.isMeshVisible[meshIdx]) continue;
+
+			Mesh* currentMesh = m_pMeshes[meshIdx];
+			const int lodIdx = snapshot.meshLods[meshIdx];
+			// The cull mode the meshlets of this frame were culled with, not the live one
+			const CullModes cullMode = snapshot.cullModes[meshIdx];
+
+			auto& verticesOut = currentMesh->GetOutVertices(rasterBuffer);
+			auto&  indices = currentMesh->GetIndices(lodIdx);
+
+			int nrOfTriangles;
 
-				//RENDER LOGIC
-				//loops through all triangles
-				for (int idx{ 0 }; idx < nrOfTriangles; idx++)
+			if (currentMesh->GetPrimitiveTopology() == TriangleList)
+			{
+				nrOfTriangles = indices.size() / 3;
+			}
+
+			else
+			{
+				nrOfTriangles = indices.size() - 2;
+			}
+
+			// Keeps the visible triangles of a range, in submission order
+			const auto addTriangles = [&](int firstTriangle, int endTriangle)
+			{
+				for (int idx{ firstTriangle }; idx < endTriangle; idx++)
 				{
 					uint32_t indice0;
 					uint32_t indice1;
@@ -182,300 +332,1052 @@ namespace dae {
 						indice2 = indices[idx + 2];
 					}
 
-					int minX;
-					int minY;
-					int maxX;
-					int maxY;
-
-					std::array<Vector4, 3> triangle{ verticesOut[indice0].Position,
-													 verticesOut[indice1].Position,
-													 verticesOut[indice2].Position };
+					const std::array<const VertexOut*, 3> vertices{ &verticesOut[indice0], &verticesOut[indice1], &verticesOut[indice2] };
 
-					if (!IsInFrustum(triangle)) continue;
+					// All three vertices are outside of the same frustum plane
+					if (vertices[0]->Outcode & vertices[1]->Outcode & vertices[2]->Outcode & OutcodeFrustum) continue;
 
-					ConvertToRasterSpace(triangle);
-					CalculateBoundingBox(minX, minY, maxX, maxY, triangle);
+					// Triangles that cross a screen edge but stay inside the guard band are rasterized directly,
+					// only the near plane and the guard band need geometric clipping
+					const uint16_t clipPlanes = (vertices[0]->Outcode | vertices[1]->Outcode | vertices[2]->Outcode) & (OutcodeNear | OutcodeGuardBand);
 
-					Vector3 a {triangle[0], triangle[1]};
-					Vector3 b {triangle[1], triangle[2]};
-					Vector3 c {triangle[2], triangle[0]};
-
-					const Vector3 n{ Vector3::Cross(a,b).Normalized() };
-
-					for (int py{ minY }, px; py < maxY; ++py) 
-					for (px = minX; px < maxX; ++px)
+					if (clipPlanes == 0)
 					{
-						const int depthBufferIndex{ px + (py * m_Width) };
+						AddRasterTriangle(currentMesh, cullMode, idx, vertices);
+						continue;
+					}
 
-						ColorRGBA finalColor{ 0, 0, 0 };
-						Vector2 P{ px + 0.5f,py + 0.5f };
+					std::array<VertexOut, 9> polygon{ *vertices[0], *vertices[1], *vertices[2] };
+					const int nrOfVertices = ClipPolygon(polygon, 3, clipPlanes);
 
-						if (m_IsBoundingBoxVisualisation) 
-						{
-							finalColor = ColorRGBA(1, 1, 1);
+					// Clipped polygon is convex, fan it back into triangles
+					for (int vertexIdx{ 2 }; vertexIdx < nrOfVertices; vertexIdx++)
+					{
+						AddRasterTriangle(currentMesh, cullMode, idx, { &polygon[0], &polygon[vertexIdx - 1], &polygon[vertexIdx] });
+					}
+				}
+			};
 
-							if (px == maxX - 1) finalColor = ColorRGBA(1, 0, 0);
-							if (px == minX) finalColor = ColorRGBA(1, 0, 0);
-							if (py == maxY - 1) finalColor = ColorRGBA(1, 0, 0);
-							if (py == minY) finalColor = ColorRGBA(1, 0, 0);
+			if (snapshot.isMeshletCulled[meshIdx])
+			{
+				// Only the triangles of the meshlets that survived culling, their vertices are the only ones that were transformed
+				const std::vector<Meshlet>& meshlets = currentMesh->GetMeshlets(lodIdx);
+				const MeshletVisibility& visibility = currentMesh->GetMeshletVisibility(rasterBuffer);
 
+				for (uint32_t meshletIdx : visibility.meshlets)
+				{
+					addTriangles(meshlets[meshletIdx].firstTriangle, meshlets[meshletIdx].firstTriangle + meshlets[meshletIdx].nrOfTriangles);
+				}
 
-							m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-								static_cast<uint8_t>(finalColor.r * 255),
-								static_cast<uint8_t>(finalColor.g * 255),
-								static_cast<uint8_t>(finalColor.b * 255));
+				m_FrameStats.meshlets += static_cast<uint32_t>(meshlets.size());
+				m_FrameStats.culledMeshlets += static_cast<uint32_t>(meshlets.size() - visibility.meshlets.size());
+			}
+			else
+			{
+				addTriangles(0, nrOfTriangles);
+			}
+		}
 
-							continue;
-						}
+		//RENDER LOGIC
+		BuildDrawOrder();
 
-						float triangleArea = Vector2::Cross(a.GetXY(), b.GetXY());
-						if (!currentMesh->GetUsesTransparency())
-						{
-							if (triangleArea < 0 && currentMesh->GetCurrentCullMode() == BackFaceCull)
-								continue;
+		if (m_IsMultithreaded)
+		{
+			// Every tile only touches its own pixels and keeps the draw order, so the result matches the single threaded path
+			BinTriangles();
+			m_ThreadPool.ParallelFor(m_NrOfTilesX * m_NrOfTilesY, [this](int tileIdx) { RasterizeTile(tileIdx); });
+		}
+		else
+		{
+			for (const RasterTriangle& rasterTriangle : m_RasterTriangles)
+			{
+				// maxX and maxY are exclusive
+				for (int tileY{ rasterTriangle.minY / TileSize }; tileY <= (rasterTriangle.maxY - 1) / TileSize; tileY++)
+				for (int tileX{ rasterTriangle.minX / TileSize }; tileX <= (rasterTriangle.maxX - 1) / TileSize; tileX++)
+				{
+					ClearTile(tileX + tileY * m_NrOfTilesX);
+				}
+			}
 
-							if (triangleArea > 0 && currentMesh->GetCurrentCullMode() == FrontFaceCull)
-								continue;
+			RasterizeRegion(m_DrawOrder, 0, 0, m_Width, m_Height);
+		}
 
-						}
-						
-						std::array<float, 3> weights{
-							Vector2::Cross(Vector2(P, triangle[1].GetXY()), b.GetXY()),
-							Vector2::Cross(Vector2(P, triangle[2].GetXY()), c.GetXY()),
-							Vector2::Cross(Vector2(P, triangle[0].GetXY()), a.GetXY())
-						};
+		FillUntouchedTiles();
 
-						weights[0] /= triangleArea;
-						weights[1] /= triangleArea;
-						weights[2] /= triangleArea;
+		//@END
+		//Update SDL Surface
+		SDL_UnlockSurface(m_pBackBuffer);
+		SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
+		SDL_UpdateWindowSurface(m_pWindow);
+	}
 
-						if( !(weights[0] > 0 && weights[1] > 0 && weights[2] > 0) || (weights[0] < 0 && weights[1] < 0 && weights[2] < 0)) continue;
+	void Renderer::RenderHardware() const
+	{
+		ColorRGBA backgroundColor{ .1f, .1f, .1f };
 
+		if (m_UniformColor == false)
+		{
+			backgroundColor = { .39f, .59f, .93f };
+		}
 
-						float ZInterpolated = 1.f / (weights[0] / triangle[0].z +
-							weights[1] / triangle[1].z +
-							weights[2] / triangle[2].z);
+		if (!m_IsInitialized)
+			return;
 
-						float WInterpolated = 1.f / (weights[0] / triangle[0].w +
-							weights[1] / triangle[1].w +
-							weights[2] / triangle[2].w);
+		// 1. CLEAR RTV & DSV
+		float color[4] = { backgroundColor.r, backgroundColor.g, backgroundColor.b };
+		m_pDeviceContext->ClearRenderTargetView(m_pRenderTargetView, color);
+		m_pDeviceContext->ClearDepthStencilView(m_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.f, 0);
 
-						if (ZInterpolated >= m_pDepthBufferPixels[depthBufferIndex] || ZInterpolated <= 0 || ZInterpolated >= 1)
-							continue;
+		// 1.5. GetWorldProjectionViewMatrix
+		for (size_t meshIdx{ 0 }; meshIdx < m_pMeshes.size(); meshIdx++)
+		{
+			Mesh* mesh = m_pMeshes[meshIdx];
+			if (mesh == m_pMeshes[1] && m_RenderFireMesh == false) continue;
+			if (!mesh->GetBoundingVolumes().IsInFrustum(m_Camera.frustumPlanes, mesh->GetWorldMatrix())) continue;
 
-						VertexOut interpolatedValues;
-						InterpolateValues(interpolatedValues, triangle, *currentMesh, WInterpolated, idx, weights);
+	
+			Matrix worldViewProjectionMatrix = mesh->GetWorldMatrix() * m_Camera.viewMatrix * m_Camera.projectionMatrix;
+			Matrix worldMatrix = mesh->GetWorldMatrix();
 
-						interpolatedValues.Position.z = ZInterpolated;
-						interpolatedValues.Position.w = WInterpolated;
+			// 2. SET PIPELINE + INVOKE DRAW CALLS (= RENDER)
+			mesh->Render(m_pDeviceContext, worldMatrix, worldViewProjectionMatrix, m_Camera.GetOrigin(), m_MeshLods[meshIdx]);
+		
+			
 
+		}
 
-						if (!currentMesh->GetUsesTransparency()) m_pDepthBufferPixels[depthBufferIndex] = ZInterpolated;
 
-						if (m_IsRenderingDepthBuffer) 
-						{
-							Utils::Remap(ZInterpolated, 0.985f, 1);
-							finalColor = ColorRGBA(ZInterpolated, ZInterpolated, ZInterpolated);
-						}
-						else 
-							finalColor = PixelShading(interpolatedValues, currentMesh);
+		// 3. PRESENT BACKBUFFER (SWAP)
+		m_pSwapChain->Present(0, 0);
+	}
 
-						uint8_t r, g, b;
-						SDL_GetRGB(m_pBackBufferPixels[depthBufferIndex], m_pBackBuffer->format, &r, &g, &b);
 
-						finalColor *= finalColor.a;
+	void Renderer::BuildDrawOrder()
+	{
+		m_DrawOrder.resize(m_RasterTriangles.size());
 
-						finalColor += ColorRGBA(r/255.f, g / 255.f, b / 255.f) * (1 - finalColor.a);
+		if (!m_IsSortingTransparency)
+		{
+			// Submission order
+			std::iota(m_DrawOrder.begin(), m_DrawOrder.end(), 0);
+			return;
+		}
 
-						// Update Color in Buffer
-						finalColor.MaxToOne();
-						m_pBackBufferPixels[depthBufferIndex] = SDL_MapRGB(m_pBackBuffer->format,
-							static_cast<uint8_t>(finalColor.r * 255),
-							static_cast<uint8_t>(finalColor.g * 255),
-							static_cast<uint8_t>(finalColor.b * 255));
+		// Opaque triangles keep their submission order and go first, the transparent ones follow back to front
+		m_DrawOrder.clear();
+		m_SortItems.clear();
 
-					}
-					
+		float minDepth{ FLT_MAX };
+		float maxDepth{ 0.f };
 
+		for (uint32_t triangleIdx{}; triangleIdx < m_RasterTriangles.size(); triangleIdx++)
+		{
+			const RasterTriangle& rasterTriangle = m_RasterTriangles[triangleIdx];
 
-				}
+			if (!rasterTriangle.usesTransparency)
+			{
+				m_DrawOrder.push_back(triangleIdx);
+				continue;
 			}
 
-			//@END
-			//Update SDL Surface
-			SDL_UnlockSurface(m_pBackBuffer);
-			SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
-			SDL_UpdateWindowSurface(m_pWindow);
+			// View depth of the centroid, w is the view space z
+			const float viewDepth = (rasterTriangle.vertices[0].w + rasterTriangle.vertices[1].w + rasterTriangle.vertices[2].w) / 3.f;
+			minDepth = std::min(minDepth, viewDepth);
+			maxDepth = std::max(maxDepth, viewDepth);
+
+			// Depth is quantized once the range is known, keep it in the key bits for now
+			m_SortItems.push_back((uint64_t(std::bit_cast<uint32_t>(viewDepth)) << 32) | triangleIdx);
 		}
 
-		else
+		if (m_SortItems.empty()) return;
+
+		// Farthest gets key 0, so sorting ascending draws back to front
+		const float depthToKey = maxDepth > minDepth ? 65535.f / (maxDepth - minDepth) : 0.f;
+		for (uint64_t& item : m_SortItems)
 		{
-			if (m_UniformColor == false)
-			{
-				backgroundColor = { .39f, .59f, .93f };
-			}
+			const float viewDepth = std::bit_cast<float>(static_cast<uint32_t>(item >> 32));
+			const uint64_t key = static_cast<uint64_t>(std::min((maxDepth - viewDepth) * depthToKey, 65535.f));
+			item = (key << 32) | (item & 0xFFFFFFFF);
+		}
 
-			if (!m_IsInitialized)
-				return;
+		RadixSortByKey(m_SortItems, m_SortScratch);
 
-			// 1. CLEAR RTV & DSV
-			float color[4] = { backgroundColor.r, backgroundColor.g, backgroundColor.b };
-			m_pDeviceContext->ClearRenderTargetView(m_pRenderTargetView, color);
-			m_pDeviceContext->ClearDepthStencilView(m_pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.f, 0);
+		for (const uint64_t item : m_SortItems)
+		{
+			m_DrawOrder.push_back(static_cast<uint32_t>(item));
+		}
+	}
 
-			// 1.5. GetWorldProjectionViewMatrix
-			for (auto mesh : m_pMeshes)
-			{
-				if (mesh == m_pMeshes[1] && m_RenderFireMesh == false) continue;
+	void Renderer::BinTriangles()
+	{
+		for (auto& tileBin : m_TileBins)
+		{
+			tileBin.clear();
+		}
 
-		
-				Matrix worldViewProjectionMatrix = mesh->GetWorldMatrix() * m_Camera.viewMatrix * m_Camera.projectionMatrix;
-				Matrix worldMatrix = mesh->GetWorldMatrix();
+		for (const uint32_t triangleIdx : m_DrawOrder)
+		{
+			const RasterTriangle& rasterTriangle = m_RasterTriangles[triangleIdx];
 
-				// 2. SET PIPELINE + INVOKE DRAW CALLS (= RENDER)
-				mesh->Render(m_pDeviceContext, worldMatrix, worldViewProjectionMatrix, m_Camera.GetOrigin());
-			
-				
+			// maxX and maxY are exclusive
+			const int minTileX = rasterTriangle.minX / TileSize;
+			const int minTileY = rasterTriangle.minY / TileSize;
+			const int maxTileX = (rasterTriangle.maxX - 1) / TileSize;
+			const int maxTileY = (rasterTriangle.maxY - 1) / TileSize;
 
+			for (int tileY{ minTileY }; tileY <= maxTileY; tileY++)
+			for (int tileX{ minTileX }; tileX <= maxTileX; tileX++)
+			{
+				m_TileBins[tileX + tileY * m_NrOfTilesX].push_back(triangleIdx);
 			}
-
-
-			// 3. PRESENT BACKBUFFER (SWAP)
-			m_pSwapChain->Present(0, 0);
 		}
-		
-
 	}
 
-
-	HRESULT Renderer::InitializeDirectX()
+	void Renderer::RasterizeTile(int tileIdx) const
 	{
-		// 1. Create Device & DeviceContext
-
-		D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_1;
-		uint32_t createDeviceFlags = 0;
+		// Untouched tiles are filled in FillUntouchedTiles
+		if (m_TileBins[tileIdx].empty()) return;
 
-	#if defined(DEBUG) || defined(_DEBUG)
-		createDeviceFlags |= D3D10_CREATE_DEVICE_DEBUG;
-	#endif
+		ClearTile(tileIdx);
 
-		HRESULT result = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, 0, createDeviceFlags, &featureLevel,
-			1, D3D11_SDK_VERSION, &m_pDevice, nullptr, &m_pDeviceContext);
+		int tileMinX, tileMinY, tileMaxX, tileMaxY;
+		GetTileBounds(tileIdx, tileMinX, tileMinY, tileMaxX, tileMaxY);
 
-		if (FAILED(result))
-		{
-			std::cout << "failed to index Create Device" << std::endl;
-			return result;
-		}
+		RasterizeRegion(m_TileBins[tileIdx], tileMinX, tileMinY, tileMaxX, tileMaxY);
+	}
 
+	void Renderer::GetTileBounds(int tileIdx, int& minX, int& minY, int& maxX, int& maxY) const
+	{
+		minX = (tileIdx % m_NrOfTilesX) * TileSize;
+		minY = (tileIdx / m_NrOfTilesX) * TileSize;
+		maxX = std::min(minX + TileSize, m_Width);
+		maxY = std::min(minY + TileSize, m_Height);
+	}
 
-		// 2. Create a Swapchain
+	void Renderer::ClearTile(int tileIdx) const
+	{
+		// Only the first touch in a frame clears
+		if (m_TileClearFrames[tileIdx] == m_FrameNumber) return;
 
-		IDXGIFactory1* pDxgiFactory{};
+		m_TileClearFrames[tileIdx] = m_FrameNumber;
+		m_TileFillColors[tileIdx] = 0;
 
-		result = CreateDXGIFactory1(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(&pDxgiFactory));
+		int tileMinX, tileMinY, tileMaxX, tileMaxY;
+		GetTileBounds(tileIdx, tileMinX, tileMinY, tileMaxX, tileMaxY);
 
-		if (FAILED(result))
+		for (int py{ tileMinY }; py < tileMaxY; ++py)
 		{
-			std::cout << "failed to index Create Factory" << std::endl;
-			return result;
+			std::fill(&m_pBackBufferPixels[tileMinX + (py * m_Width)], &m_pBackBufferPixels[tileMaxX + (py * m_Width)], m_ClearColor);
+			std::fill(&m_pDepthBufferPixels[tileMinX + (py * m_Width)], &m_pDepthBufferPixels[tileMaxX + (py * m_Width)], FLT_MAX);
 		}
 
-		DXGI_SWAP_CHAIN_DESC swapChainDesc{};
-		swapChainDesc.BufferDesc.Width = m_Width;
-		swapChainDesc.BufferDesc.Height = m_Height;
-		swapChainDesc.BufferDesc.RefreshRate.Numerator = 1;
-		swapChainDesc.BufferDesc.RefreshRate.Denominator = 60;
-		swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-		swapChainDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-		swapChainDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-		swapChainDesc.SampleDesc.Count = 1;
-		swapChainDesc.SampleDesc.Quality = 0;
-		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-		swapChainDesc.BufferCount = 1;
-		swapChainDesc.Windowed = true;
-		swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
-		swapChainDesc.Flags = 0;
+		if (m_IsHiZ)
+		{
+			m_pHiZTileDepths[tileIdx] = FLT_MAX;
 
-		// Get the handle (HWND) from the SDL backbuffer
-		SDL_SysWMinfo sysWMInfo{};
-		SDL_GetVersion(&sysWMInfo.version);
-		SDL_GetWindowWMInfo(m_pWindow, &sysWMInfo);
-		swapChainDesc.OutputWindow = sysWMInfo.info.win.window;
+			for (int blockY{ tileMinY / SmallBlockSize }; blockY < (tileMaxY + SmallBlockSize - 1) / SmallBlockSize; blockY++)
+			{
+				std::fill(&m_pHiZBlockDepths[tileMinX / SmallBlockSize + blockY * m_NrOfHiZBlocksX],
+					&m_pHiZBlockDepths[(tileMaxX + SmallBlockSize - 1) / SmallBlockSize + blockY * m_NrOfHiZBlocksX], FLT_MAX);
+			}
+		}
+	}
 
-		// Create SwapChain
-		result = pDxgiFactory->CreateSwapChain(m_pDevice, &swapChainDesc, &m_pSwapChain);
-		if (FAILED(result))
+	void Renderer::FillUntouchedTiles()
+	{
+		for (int tileIdx{ 0 }; tileIdx < m_NrOfTilesX * m_NrOfTilesY; tileIdx++)
 		{
-			std::cout << "failed to index Create Swap Chain" << std::endl;
-			return result;
-		}
+			// Drawn in this frame
+			if (m_TileClearFrames[tileIdx] == m_FrameNumber) continue;
 
-		// 3. Create DepthStencil (DS) & DepthStencilView (DSV)
-		// Resource
-		D3D11_TEXTURE2D_DESC depthStencilDesc{};
-		depthStencilDesc.Width = m_Width;
-		depthStencilDesc.Height = m_Height;
-		depthStencilDesc.MipLevels = 1;
-		depthStencilDesc.ArraySize = 1;
-		depthStencilDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-		depthStencilDesc.SampleDesc.Count = 1;
-		depthStencilDesc.SampleDesc.Quality = 0;
-		depthStencilDesc.Usage = D3D11_USAGE_DEFAULT;
-		depthStencilDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-		depthStencilDesc.CPUAccessFlags = 0;
-		depthStencilDesc.MiscFlags = 0;
+			// Still filled with the clear color from an earlier frame
+			if (m_TileFillColors[tileIdx] == m_ClearColor) continue;
 
-		// View
-		D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc{};
-		depthStencilViewDesc.Format = depthStencilViewDesc.Format;
-		depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-		depthStencilViewDesc.Texture2D.MipSlice = 0;
+			int tileMinX, tileMinY, tileMaxX, tileMaxY;
+			GetTileBounds(tileIdx, tileMinX, tileMinY, tileMaxX, tileMaxY);
 
-		result = m_pDevice->CreateTexture2D(&depthStencilDesc, nullptr, &m_pDepthStencilBuffer);
+			for (int py{ tileMinY }; py < tileMaxY; ++py)
+			{
+				std::fill(&m_pBackBufferPixels[tileMinX + (py * m_Width)], &m_pBackBufferPixels[tileMaxX + (py * m_Width)], m_ClearColor);
+			}
 
-		if (FAILED(result))
-		{
-			std::cout << "failed to index Create Texture2D" << std::endl;
-			return result;
+			m_TileFillColors[tileIdx] = m_ClearColor;
 		}
+	}
 
-		result = m_pDevice->CreateDepthStencilView(m_pDepthStencilBuffer, &depthStencilViewDesc, &m_pDepthStencilView);
-
-		if (FAILED(result))
+	void Renderer::RasterizeRegion(const std::vector<uint32_t>& triangleIndices, int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const
+	{
+		if ((!m_IsDeferredShading && !m_IsOrderIndependentTransparency) || m_IsBoundingBoxVisualisation)
 		{
-			std::cout << "failed to index Create Depth Stencil" << std::endl;
-			return result;
-		}
-
-		// 4. Create RenderTarget (RT) & RenderTargetView (RTV)
+			for (const uint32_t triangleIdx : triangleIndices)
+			{
+				RasterizeTriangle(m_RasterTriangles[triangleIdx], regionMinX, regionMinY, regionMaxX, regionMaxY);
+			}
 
-		//Resources
-		result = m_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&m_pRenderTargetBuffer));
+			FlushThreadCounters(m_FrameStats);
+			return;
+		}
 
-		if (FAILED(result))
+		// 1. Opaque triangles first, in deferred mode they only write depth and which triangle is closest
+		for (const uint32_t triangleIdx : triangleIndices)
 		{
-			std::cout << "failed to index Create Render Target" << std::endl;
-			return result;
+			if (!m_RasterTriangles[triangleIdx].usesTransparency)
+				RasterizeTriangle(m_RasterTriangles[triangleIdx], regionMinX, regionMinY, regionMaxX, regionMaxY);
 		}
 
-		// View
-		result = m_pDevice->CreateRenderTargetView(m_pRenderTargetBuffer, nullptr, &m_pRenderTargetView);
+		// 2. Shade every visible pixel exactly once
+		if (m_IsDeferredShading) ResolveVisibility(regionMinX, regionMinY, regionMaxX, regionMaxY);
 
-		if (FAILED(result))
+		// 3. Transparent triangles on top, blended in submission order or accumulated for the OIT resolve
+		for (const uint32_t triangleIdx : triangleIndices)
 		{
-			std::cout << "failed to index Create Render View" << std::endl;
-			return result;
+			if (m_RasterTriangles[triangleIdx].usesTransparency)
+				RasterizeTriangle(m_RasterTriangles[triangleIdx], regionMinX, regionMinY, regionMaxX, regionMaxY);
 		}
 
-		// 5. Bind RTV & DSV to Output Merger Stage
+		// 4. Composite the accumulated transparency over the opaque result
+		if (m_IsOrderIndependentTransparency) ResolveTransparency(regionMinX, regionMinY, regionMaxX, regionMaxY);
 
-		m_pDeviceContext->OMSetRenderTargets(1, &m_pRenderTargetView, m_pDepthStencilView);
+		FlushThreadCounters(m_FrameStats);
+	}
 
-		// 6. Set Viewport
+	void Renderer::ResolveVisibility(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const
+	{
+		const int rowWidth{ regionMaxX - regionMinX };
+		t_RowColors.resize(rowWidth);
 
-		D3D11_VIEWPORT viewport{};
-		viewport.Width = static_cast<float>(m_Width);
+		for (int py{ regionMinY }; py < regionMaxY; ++py)
+		{
+			uint32_t* pRowPixels = &m_pBackBufferPixels[regionMinX + (py * m_Width)];
+			bool isRowShaded{ false };
+
+			for (int px{ regionMinX }; px < regionMaxX; ++px)
+			{
+				const int pixelIdx{ px + (py * m_Width) };
+
+				const int closestTriangle = m_ClosestTriangle[pixelIdx];
+				if (closestTriangle < 0) continue;
+
+				// Pixels without geometry keep the clear color, so the row is only unpacked once something covers it
+				if (!isRowShaded)
+				{
+					UnpackPixels(pRowPixels, t_RowColors.data(), rowWidth);
+					isRowShaded = true;
+				}
+
+				// Reset for the next frame while we are here
+				m_ClosestTriangle[pixelIdx] = -1;
+
+				// The plane equations of the triangle give back the barycentric interpolated attributes at this pixel
+				t_RowColors[px - regionMinX] = ShadeFragment(m_RasterTriangles[closestTriangle], px + 0.5f, py + 0.5f, m_pDepthBufferPixels[pixelIdx]);
+
+				++t_ShadedPixels;
+			}
+
+			if (isRowShaded) PackPixels(t_RowColors.data(), pRowPixels, rowWidth);
+		}
+	}
+
+	void Renderer::AccumulateTransparentFragment(int pixelIdx, const ColorRGBA& color, float viewDepth) const
+	{
+		// McGuire and Bavoil, Weighted Blended Order-Independent Transparency, equation 7:
+		// closer fragments get a larger weight, so the front layers dominate the average
+		const float alpha = std::clamp(color.a, 0.f, 1.f);
+		const float depthWeight = std::clamp(10.f / (1e-5f + powf(viewDepth / 5.f, 2) + powf(viewDepth / 200.f, 6)), 1e-2f, 3e3f);
+		const float weight = alpha * depthWeight;
+
+		m_TransparentAccumulation[0][pixelIdx] += color.r * weight;
+		m_TransparentAccumulation[1][pixelIdx] += color.g * weight;
+		m_TransparentAccumulation[2][pixelIdx] += color.b * weight;
+		m_TransparentAccumulation[3][pixelIdx] += weight;
+
+		m_TransparentRevealage[pixelIdx] *= 1.f - alpha;
+	}
+
+	void Renderer::ResolveTransparency(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const
+	{
+		// color = average transparent color * (1 - revealage) + opaque color * revealage,
+		// the opaque color stays in 0 - 255 so untouched pixels (revealage 1) come back unchanged
+		const auto resolvePixel = [&](int pixelIdx)
+		{
+			const float revealage = m_TransparentRevealage[pixelIdx];
+			if (revealage >= 1.f) return;
+
+			const float invTotalWeight = 255.f * (1.f - revealage) / std::max(m_TransparentAccumulation[3][pixelIdx], 1e-5f);
+
+			const uint32_t opaquePixel = m_pBackBufferPixels[pixelIdx];
+			const std::array<int, 3> shifts{ 16, 8, 0 };
+
+			uint32_t resolvedPixel{ 0xFF000000 };
+			for (int channel{ 0 }; channel < 3; channel++)
+			{
+				const float opaque = static_cast<float>((opaquePixel >> shifts[channel]) & 0xFF);
+				const float resolved = std::min(m_TransparentAccumulation[channel][pixelIdx] * invTotalWeight + opaque * revealage, 255.f);
+
+				resolvedPixel |= static_cast<uint32_t>(resolved) << shifts[channel];
+			}
+			m_pBackBufferPixels[pixelIdx] = resolvedPixel;
+
+			for (auto& accumulation : m_TransparentAccumulation)
+			{
+				accumulation[pixelIdx] = 0.f;
+			}
+			m_TransparentRevealage[pixelIdx] = 1.f;
+		};
+
+#if defined(DAE_SIMD_AVX2) || defined(DAE_SIMD_SSE)
+		const Simd::Float zero = Simd::Set(0.f);
+		const Simd::Float one = Simd::Set(1.f);
+		const Simd::Float maxChannel = Simd::Set(255.f);
+		const Simd::Float minWeight = Simd::Set(1e-5f);
+		const Simd::Int channelMask = Simd::SetInt(0xFF);
+		const Simd::Int alphaMask = Simd::SetInt(0xFF000000);
+		const std::array<int, 3> shifts{ 16, 8, 0 };
+#endif
+
+		for (int py{ regionMinY }; py < regionMaxY; ++py)
+		{
+			int px{ regionMinX };
+
+#if defined(DAE_SIMD_AVX2) || defined(DAE_SIMD_SSE)
+			for (; px + Simd::Width <= regionMaxX; px += Simd::Width)
+			{
+				const int pixelIdx{ px + (py * m_Width) };
+
+				const Simd::Float revealage = Simd::Load(&m_TransparentRevealage[pixelIdx]);
+				if (Simd::MoveMask(Simd::LessThan(revealage, one)) == 0) continue;
+
+				const Simd::Float invTotalWeight = Simd::Div(Simd::Mul(maxChannel, Simd::Sub(one, revealage)),
+					Simd::Max(Simd::Load(&m_TransparentAccumulation[3][pixelIdx]), minWeight));
+
+				const Simd::Int opaquePixels = Simd::LoadInt(&m_pBackBufferPixels[pixelIdx]);
+				Simd::Int resolvedPixels = alphaMask;
+
+				for (int channel{ 0 }; channel < 3; channel++)
+				{
+					const Simd::Float opaque = Simd::ToFloat(Simd::AndInt(Simd::ShiftRight(opaquePixels, shifts[channel]), channelMask));
+					const Simd::Float transparent = Simd::Mul(Simd::Load(&m_TransparentAccumulation[channel][pixelIdx]), invTotalWeight);
+					const Simd::Float resolved = Simd::Min(Simd::Add(transparent, Simd::Mul(opaque, revealage)), maxChannel);
+
+					resolvedPixels = Simd::OrInt(resolvedPixels, Simd::ShiftLeft(Simd::ToIntTruncate(resolved), shifts[channel]));
+				}
+
+				Simd::StoreInt(&m_pBackBufferPixels[pixelIdx], resolvedPixels);
+
+				for (auto& accumulation : m_TransparentAccumulation)
+				{
+					Simd::Store(&accumulation[pixelIdx], zero);
+				}
+				Simd::Store(&m_TransparentRevealage[pixelIdx], one);
+			}
+#endif
+
+			// Leftover pixels at the end of the row
+			for (; px < regionMaxX; ++px)
+			{
+				resolvePixel(px + (py * m_Width));
+			}
+		}
+	}
+
+	void Renderer::RasterizeTriangle(const RasterTriangle& rasterTriangle, int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const
+	{
+		// Bounding box of the triangle clipped to the region (a tile or the whole screen)
+		const int startX = std::max(rasterTriangle.minX, regionMinX);
+		const int startY = std::max(rasterTriangle.minY, regionMinY);
+		const int endX = std::min(rasterTriangle.maxX, regionMaxX);
+		const int endY = std::min(rasterTriangle.maxY, regionMaxY);
+
+		if (m_IsBoundingBoxVisualisation)
+		{
+			RasterizeBoundingBox(rasterTriangle, startX, startY, endX, endY);
+			return;
+		}
+
+		// Hi-Z rejects per tile and per 8x8 block, so it needs the block walk as well
+		if (m_IsHierarchical || m_IsHiZ)
+		{
+			RasterizeBlocks(rasterTriangle, startX, startY, endX, endY, LargeBlockSize);
+			return;
+		}
+
+		RasterizeWithKernel(rasterTriangle, startX, startY, endX, endY);
+	}
+
+	void Renderer::RasterizeWithKernel(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const
+	{
+		switch (m_CurrentRasterKernel)
+		{
+		case FixedPointKernel:
+			RasterizeTriangleFixedPoint(rasterTriangle, startX, startY, endX, endY);
+			break;
+		case SimdKernel:
+			RasterizeTriangleSimd(rasterTriangle, startX, startY, endX, endY);
+			break;
+		case FloatKernel:
+		default:
+			RasterizeTriangleFloat(rasterTriangle, startX, startY, endX, endY);
+			break;
+		}
+	}
+
+	void Renderer::RasterizeBlocks(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY, int blockSize) const
+	{
+		BlockCounters& counters = blockSize == LargeBlockSize ? m_FrameStats.largeBlocks : m_FrameStats.smallBlocks;
+
+		// Blocks are aligned to the screen, so the 64x64 blocks line up with the tiles
+		for (int blockY{ startY - startY % blockSize }; blockY < endY; blockY += blockSize)
+		for (int blockX{ startX - startX % blockSize }; blockX < endX; blockX += blockSize)
+		{
+			const int blockStartX = std::max(blockX, startX);
+			const int blockStartY = std::max(blockY, startY);
+			const int blockEndX = std::min(blockX + blockSize, endX);
+			const int blockEndY = std::min(blockY + blockSize, endY);
+
+			const BlockCoverage coverage = ClassifyBlock(rasterTriangle, blockStartX, blockStartY, blockEndX, blockEndY);
+
+			if (coverage == BlockOutside)
+			{
+				counters.outside.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+
+			if (m_IsHiZ && IsOccludedByHiZ(rasterTriangle, blockStartX, blockStartY, blockEndX, blockEndY, blockSize)) continue;
+
+			if (coverage == BlockInside)
+			{
+				counters.inside.fetch_add(1, std::memory_order_relaxed);
+
+				// Every pixel is covered, no edge tests needed
+				for (int py{ blockStartY }; py < blockEndY; ++py)
+				for (int px{ blockStartX }; px < blockEndX; ++px)
+				{
+					ShadePixel(rasterTriangle, px, py);
+				}
+			}
+			else
+			{
+				counters.partial.fetch_add(1, std::memory_order_relaxed);
+
+				if (blockSize > SmallBlockSize)
+				{
+					// The 8x8 blocks keep their own Hi-Z depths up to date, the tile is updated once after all of them
+					RasterizeBlocks(rasterTriangle, blockStartX, blockStartY, blockEndX, blockEndY, SmallBlockSize);
+
+					if (m_IsHiZ && !rasterTriangle.usesTransparency)
+						UpdateHiZTiles(blockStartX, blockStartY, blockEndX, blockEndY);
+					continue;
+				}
+
+				RasterizeWithKernel(rasterTriangle, blockStartX, blockStartY, blockEndX, blockEndY);
+			}
+
+			if (m_IsHiZ && !rasterTriangle.usesTransparency)
+			{
+				UpdateHiZBlocks(blockStartX, blockStartY, blockEndX, blockEndY);
+				if (blockSize == LargeBlockSize) UpdateHiZTiles(blockStartX, blockStartY, blockEndX, blockEndY);
+			}
+		}
+	}
+
+	bool Renderer::IsOccludedByHiZ(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY, int blockSize) const
+	{
+		static_assert(LargeBlockSize == TileSize, "Hi-Z tiles and the large blocks have to line up");
+
+		HiZCounters& counters = blockSize == LargeBlockSize ? m_FrameStats.hiZTiles : m_FrameStats.hiZBlocks;
+		counters.tested.fetch_add(1, std::memory_order_relaxed);
+
+		const float farthestDepth = blockSize == LargeBlockSize
+			? m_pHiZTileDepths[startX / TileSize + (startY / TileSize) * m_NrOfTilesX]
+			: m_pHiZBlockDepths[startX / SmallBlockSize + (startY / SmallBlockSize) * m_NrOfHiZBlocksX];
+
+		// Depth is linear, so its minimum over the block is at the center of a corner pixel, and never in front of the closest vertex
+		const PlaneEquation& depth = rasterTriangle.depth;
+		const float minX{ startX + 0.5f };
+		const float minY{ startY + 0.5f };
+		const float maxX{ endX - 0.5f };
+		const float maxY{ endY - 0.5f };
+
+		const float closestDepth = std::max(rasterTriangle.minDepth, std::min({ depth.Evaluate(minX, minY), depth.Evaluate(maxX, minY),
+			depth.Evaluate(minX, maxY), depth.Evaluate(maxX, maxY) }));
+
+		// Same test as the depth buffer: fragments at or behind the stored depth are discarded
+		if (closestDepth < farthestDepth) return false;
+
+		counters.rejected.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	void Renderer::UpdateHiZBlocks(int startX, int startY, int endX, int endY) const
+	{
+		// Recompute the farthest depth of every 8x8 block that was touched
+		const int minBlockX = startX / SmallBlockSize;
+		const int minBlockY = startY / SmallBlockSize;
+		const int maxBlockX = (endX - 1) / SmallBlockSize;
+		const int maxBlockY = (endY - 1) / SmallBlockSize;
+
+		for (int blockY{ minBlockY }; blockY <= maxBlockY; blockY++)
+		for (int blockX{ minBlockX }; blockX <= maxBlockX; blockX++)
+		{
+			const int blockEndX = std::min((blockX + 1) * SmallBlockSize, m_Width);
+			const int blockEndY = std::min((blockY + 1) * SmallBlockSize, m_Height);
+
+			float farthestDepth{ 0.f };
+			for (int py{ blockY * SmallBlockSize }; py < blockEndY; ++py)
+			for (int px{ blockX * SmallBlockSize }; px < blockEndX; ++px)
+			{
+				farthestDepth = std::max(farthestDepth, m_pDepthBufferPixels[px + (py * m_Width)]);
+			}
+
+			m_pHiZBlockDepths[blockX + blockY * m_NrOfHiZBlocksX] = farthestDepth;
+		}
+	}
+
+	void Renderer::UpdateHiZTiles(int startX, int startY, int endX, int endY) const
+	{
+		// The farthest depth of every touched tile, from its blocks
+		constexpr int blocksPerTile{ TileSize / SmallBlockSize };
+
+		for (int tileY{ startY / TileSize }; tileY <= (endY - 1) / TileSize; tileY++)
+		for (int tileX{ startX / TileSize }; tileX <= (endX - 1) / TileSize; tileX++)
+		{
+			const int tileEndBlockX = std::min((tileX + 1) * blocksPerTile, m_NrOfHiZBlocksX);
+			const int tileEndBlockY = std::min((tileY + 1) * blocksPerTile, m_NrOfHiZBlocksY);
+
+			float farthestDepth{ 0.f };
+			for (int blockY{ tileY * blocksPerTile }; blockY < tileEndBlockY; blockY++)
+			for (int blockX{ tileX * blocksPerTile }; blockX < tileEndBlockX; blockX++)
+			{
+				farthestDepth = std::max(farthestDepth, m_pHiZBlockDepths[blockX + blockY * m_NrOfHiZBlocksX]);
+			}
+
+			m_pHiZTileDepths[tileX + tileY * m_NrOfTilesX] = farthestDepth;
+		}
+	}
+
+	BlockCoverage Renderer::ClassifyBlock(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const
+	{
+		// The edge functions are linear, so their extremes over the block are at the centers of the corner pixels
+		bool isInside{ true };
+
+		if (m_CurrentRasterKernel == FixedPointKernel)
+		{
+			// Use the exact fixed point edges so the top-left rule still decides pixels that lie on an edge
+			constexpr int64_t halfPixel{ SubPixelScale / 2 };
+			const int64_t minX{ int64_t(startX) * SubPixelScale + halfPixel };
+			const int64_t minY{ int64_t(startY) * SubPixelScale + halfPixel };
+			const int64_t maxX{ int64_t(endX - 1) * SubPixelScale + halfPixel };
+			const int64_t maxY{ int64_t(endY - 1) * SubPixelScale + halfPixel };
+
+			for (const FixedPointEdge& edge : rasterTriangle.fixedPointEdges)
+			{
+				const std::initializer_list<int64_t> corners{ edge.Evaluate(minX, minY), edge.Evaluate(maxX, minY),
+					edge.Evaluate(minX, maxY), edge.Evaluate(maxX, maxY) };
+
+				if (std::max(corners) < 0) return BlockOutside;
+				if (std::min(corners) < 0) isInside = false;
+			}
+		}
+		else
+		{
+			const float minX{ startX + 0.5f };
+			const float minY{ startY + 0.5f };
+			const float maxX{ endX - 0.5f };
+			const float maxY{ endY - 0.5f };
+
+			for (const PlaneEquation& weight : rasterTriangle.weights)
+			{
+				const std::initializer_list<float> corners{ weight.Evaluate(minX, minY), weight.Evaluate(maxX, minY),
+					weight.Evaluate(minX, maxY), weight.Evaluate(maxX, maxY) };
+
+				if (std::max(corners) <= 0) return BlockOutside;
+				if (std::min(corners) <= 0) isInside = false;
+			}
+		}
+
+		return isInside ? BlockInside : BlockPartial;
+	}
+
+	void Renderer::RasterizeBoundingBox(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const
+	{
+		for (int py{ startY }, px; py < endY; ++py) 
+		for (px = startX; px < endX; ++px)
+		{
+			ColorRGBA finalColor = ColorRGBA(1, 1, 1);
+
+			if (px == rasterTriangle.maxX - 1) finalColor = ColorRGBA(1, 0, 0);
+			if (px == rasterTriangle.minX) finalColor = ColorRGBA(1, 0, 0);
+			if (py == rasterTriangle.maxY - 1) finalColor = ColorRGBA(1, 0, 0);
+			if (py == rasterTriangle.minY) finalColor = ColorRGBA(1, 0, 0);
+
+
+			m_pBackBufferPixels[px + (py * m_Width)] = PackPixel(finalColor);
+		}
+	}
+
+	void Renderer::RasterizeTriangleFloat(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const
+	{
+		for (int py{ startY }, px; py < endY; ++py) 
+		for (px = startX; px < endX; ++px)
+		{
+			const float pixelX{ px + 0.5f };
+			const float pixelY{ py + 0.5f };
+
+			const float weight0 = rasterTriangle.weights[0].Evaluate(pixelX, pixelY);
+			const float weight1 = rasterTriangle.weights[1].Evaluate(pixelX, pixelY);
+			const float weight2 = rasterTriangle.weights[2].Evaluate(pixelX, pixelY);
+
+			if (!(weight0 > 0 && weight1 > 0 && weight2 > 0)) continue;
+
+			ShadePixel(rasterTriangle, px, py);
+		}
+	}
+
+	void Renderer::RasterizeTriangleFixedPoint(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const
+	{
+		if (startX >= endX || startY >= endY) return;
+
+		const auto& edges = rasterTriangle.fixedPointEdges;
+
+		// Edge values at the center of the first pixel, then stepped one pixel at a time
+		constexpr int64_t halfPixel{ SubPixelScale / 2 };
+		const int64_t startPixelX{ int64_t(startX) * SubPixelScale + halfPixel };
+		const int64_t startPixelY{ int64_t(startY) * SubPixelScale + halfPixel };
+
+		int64_t rowEdge0 = edges[0].Evaluate(startPixelX, startPixelY);
+		int64_t rowEdge1 = edges[1].Evaluate(startPixelX, startPixelY);
+		int64_t rowEdge2 = edges[2].Evaluate(startPixelX, startPixelY);
+
+		const int64_t stepX0 = edges[0].a * SubPixelScale;
+		const int64_t stepX1 = edges[1].a * SubPixelScale;
+		const int64_t stepX2 = edges[2].a * SubPixelScale;
+
+		const int64_t stepY0 = edges[0].b * SubPixelScale;
+		const int64_t stepY1 = edges[1].b * SubPixelScale;
+		const int64_t stepY2 = edges[2].b * SubPixelScale;
+
+		for (int py{ startY }; py < endY; ++py)
+		{
+			int64_t edge0 = rowEdge0;
+			int64_t edge1 = rowEdge1;
+			int64_t edge2 = rowEdge2;
+
+			for (int px{ startX }; px < endX; ++px)
+			{
+				// Checks the sign bits of all three edges at once
+				if ((edge0 | edge1 | edge2) >= 0)
+				{
+					ShadePixel(rasterTriangle, px, py);
+				}
+
+				edge0 += stepX0;
+				edge1 += stepX1;
+				edge2 += stepX2;
+			}
+
+			rowEdge0 += stepY0;
+			rowEdge1 += stepY1;
+			rowEdge2 += stepY2;
+		}
+	}
+
+	void Renderer::RasterizeTriangleSimd(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const
+	{
+#if defined(DAE_SIMD_AVX2) || defined(DAE_SIMD_SSE)
+		const auto& weights = rasterTriangle.weights;
+		const PlaneEquation& depth = rasterTriangle.depth;
+
+		const Simd::Float zero = Simd::Set(0.f);
+		const Simd::Float one = Simd::Set(1.f);
+		const Simd::Float laneCenters = Simd::Add(Simd::LaneOffsets(), Simd::Set(0.5f));
+
+		const Simd::Float weight0DX = Simd::Set(weights[0].dx);
+		const Simd::Float weight1DX = Simd::Set(weights[1].dx);
+		const Simd::Float weight2DX = Simd::Set(weights[2].dx);
+		const Simd::Float depthDX = Simd::Set(depth.dx);
+
+		for (int py{ startY }; py < endY; ++py)
+		{
+			const float pixelY{ py + 0.5f };
+
+			// Same order of operations as PlaneEquation::Evaluate: dx * x + dy * y + c
+			const Simd::Float weight0Row = Simd::Set(weights[0].dy * pixelY);
+			const Simd::Float weight1Row = Simd::Set(weights[1].dy * pixelY);
+			const Simd::Float weight2Row = Simd::Set(weights[2].dy * pixelY);
+			const Simd::Float depthRow = Simd::Set(depth.dy * pixelY);
+
+			const Simd::Float weight0C = Simd::Set(weights[0].c);
+			const Simd::Float weight1C = Simd::Set(weights[1].c);
+			const Simd::Float weight2C = Simd::Set(weights[2].c);
+			const Simd::Float depthC = Simd::Set(depth.c);
+
+			int px{ startX };
+			for (; px + Simd::Width <= endX; px += Simd::Width)
+			{
+				const Simd::Float pixelX = Simd::Add(Simd::Set(float(px)), laneCenters);
+
+				const Simd::Float weight0 = Simd::Add(Simd::Add(Simd::Mul(weight0DX, pixelX), weight0Row), weight0C);
+				const Simd::Float weight1 = Simd::Add(Simd::Add(Simd::Mul(weight1DX, pixelX), weight1Row), weight1C);
+				const Simd::Float weight2 = Simd::Add(Simd::Add(Simd::Mul(weight2DX, pixelX), weight2Row), weight2C);
+
+				const Simd::Float covered = Simd::And(Simd::And(Simd::GreaterThan(weight0, zero), Simd::GreaterThan(weight1, zero)),
+					Simd::GreaterThan(weight2, zero));
+
+				if (Simd::MoveMask(covered) == 0) continue;
+
+				const Simd::Float ZInterpolated = Simd::Add(Simd::Add(Simd::Mul(depthDX, pixelX), depthRow), depthC);
+				const Simd::Float storedDepth = Simd::Load(&m_pDepthBufferPixels[px + (py * m_Width)]);
+
+				const Simd::Float passed = Simd::And(Simd::And(covered, Simd::LessThan(ZInterpolated, storedDepth)),
+					Simd::And(Simd::GreaterThan(ZInterpolated, zero), Simd::LessThan(ZInterpolated, one)));
+
+				// Only the lanes that survived go on to shading
+				for (int laneMask{ Simd::MoveMask(passed) }; laneMask != 0; laneMask &= laneMask - 1)
+				{
+					ShadePixel(rasterTriangle, px + std::countr_zero(static_cast<unsigned int>(laneMask)), py);
+				}
+			}
+
+			// Leftover pixels at the end of the row
+			if (px < endX)
+			{
+				RasterizeTriangleFloat(rasterTriangle, px, py, endX, py + 1);
+			}
+		}
+#else
+		RasterizeTriangleFloat(rasterTriangle, startX, startY, endX, endY);
+#endif
+	}
+
+	void Renderer::ShadePixel(const RasterTriangle& rasterTriangle, int px, int py) const
+	{
+		const int depthBufferIndex{ px + (py * m_Width) };
+
+		const float pixelX{ px + 0.5f };
+		const float pixelY{ py + 0.5f };
+
+		const float ZInterpolated = rasterTriangle.depth.Evaluate(pixelX, pixelY);
+
+		if (ZInterpolated >= m_pDepthBufferPixels[depthBufferIndex] || ZInterpolated <= 0 || ZInterpolated >= 1)
+			return;
+
+		if (!rasterTriangle.usesTransparency) m_pDepthBufferPixels[depthBufferIndex] = ZInterpolated;
+
+		if (m_IsDeferredShading && !rasterTriangle.usesTransparency)
+		{
+			// Shaded later in ResolveVisibility, if it is still the closest one by then
+			m_ClosestTriangle[depthBufferIndex] = static_cast<int>(&rasterTriangle - m_RasterTriangles.data());
+			++t_VisibilityFragments;
+			return;
+		}
+
+		const ColorRGBA finalColor = ShadeFragment(rasterTriangle, pixelX, pixelY, ZInterpolated);
+
+		// Opaque pixels replace whatever is there, no need to read the back buffer
+		if (!rasterTriangle.usesTransparency)
+		{
+			m_pBackBufferPixels[depthBufferIndex] = PackPixel(finalColor);
+			return;
+		}
+
+		// Fully transparent texel, nothing to blend (most of the fire quads)
+		if (finalColor.a <= 0.f) return;
+
+		if (m_IsOrderIndependentTransparency)
+		{
+			const float WInterpolated = 1.f / rasterTriangle.invW.Evaluate(pixelX, pixelY);
+			AccumulateTransparentFragment(depthBufferIndex, finalColor, WInterpolated);
+			return;
+		}
+
+		BlendPixel(depthBufferIndex, finalColor);
+	}
+
+	ColorRGBA Renderer::ShadeFragment(const RasterTriangle& rasterTriangle, float pixelX, float pixelY, float ZInterpolated) const
+	{
+		if (m_IsRenderingDepthBuffer) 
+		{
+			Utils::Remap(ZInterpolated, 0.985f, 1);
+			return ColorRGBA(ZInterpolated, ZInterpolated, ZInterpolated);
+		}
+
+		const float WInterpolated = 1.f / rasterTriangle.invW.Evaluate(pixelX, pixelY);
+		TextureGradients gradients = ComputeTextureGradients(rasterTriangle, pixelX, pixelY);
+
+		gradients.maxAnisotropy = m_FrameAnisotropy;
+
+		// Transparent meshes only show their diffuse map, so only the UV is needed
+		if (rasterTriangle.usesTransparency)
+		{
+			const Vector2 uv{ rasterTriangle.attributes[AttributeUV].Evaluate(pixelX, pixelY) * WInterpolated,
+				rasterTriangle.attributes[AttributeUV + 1].Evaluate(pixelX, pixelY) * WInterpolated };
+
+			return rasterTriangle.pMesh->GetMaterialComponentByName(m_DiffuseMapString).pMatCompTexture->Sample(uv, gradients, rasterTriangle.pMesh, t_SampleTaps);
+		}
+
+		VertexOut interpolatedValues;
+		InterpolateValues(interpolatedValues, rasterTriangle, pixelX, pixelY, WInterpolated);
+
+		interpolatedValues.Position.z = ZInterpolated;
+		interpolatedValues.Position.w = WInterpolated;
+
+		return PixelShading(interpolatedValues, gradients, rasterTriangle.pMesh);
+	}
+
+	TextureGradients Renderer::ComputeTextureGradients(const RasterTriangle& rasterTriangle, float pixelX, float pixelY)
+	{
+		// Like a GPU, derivatives are taken per 2x2 pixel quad: all four pixels use the UV differences along the quad's
+		// top and left edge. The planes also hold outside the triangle, so quads on its edge need no helper pixels
+		const float quadX = std::floor(pixelX * .5f) * 2.f + .5f;
+		const float quadY = std::floor(pixelY * .5f) * 2.f + .5f;
+
+		const auto perspectiveUV = [&rasterTriangle](float x, float y)
+			{
+				const float w = 1.f / rasterTriangle.invW.Evaluate(x, y);
+				return Vector2{ rasterTriangle.attributes[AttributeUV].Evaluate(x, y) * w,
+					rasterTriangle.attributes[AttributeUV + 1].Evaluate(x, y) * w };
+			};
+
+		const Vector2 quadUV = perspectiveUV(quadX, quadY);
+		return { perspectiveUV(quadX + 1.f, quadY) - quadUV, perspectiveUV(quadX, quadY + 1.f) - quadUV };
+	}
+
+	void Renderer::BlendPixel(int pixelIdx, ColorRGBA finalColor) const
+	{
+		const uint32_t alpha = static_cast<uint8_t>(std::clamp(finalColor.a, 0.f, 1.f) * 255);
+
+		// source * alpha + destination * (1 - alpha), on the packed 8 bit channels
+		m_pBackBufferPixels[pixelIdx] = Simd::BlendPixel(PackPixel(finalColor), m_pBackBufferPixels[pixelIdx], alpha);
+	}
+
+	HRESULT Renderer::InitializeDirectX()
+	{
+		// 1. Create Device & DeviceContext
+
+		D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_1;
+		uint32_t createDeviceFlags = 0;
+
+	#if defined(DEBUG) || defined(_DEBUG)
+		createDeviceFlags |= D3D10_CREATE_DEVICE_DEBUG;
+	#endif
+
+		HRESULT result = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, 0, createDeviceFlags, &featureLevel,
+			1, D3D11_SDK_VERSION, &m_pDevice, nullptr, &m_pDeviceContext);
+
+		if (FAILED(result))
+		{
+			std::cout << "failed to index Create Device" << std::endl;
+			return result;
+		}
+
+
+		// 2. Create a Swapchain
+
+		IDXGIFactory1* pDxgiFactory{};
+
+		result = CreateDXGIFactory1(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(&pDxgiFactory));
+
+		if (FAILED(result))
+		{
+			std::cout << "failed to index Create Factory" << std::endl;
+			return result;
+		}
+
+		DXGI_SWAP_CHAIN_DESC swapChainDesc{};
+		swapChainDesc.BufferDesc.Width = m_Width;
+		swapChainDesc.BufferDesc.Height = m_Height;
+		swapChainDesc.BufferDesc.RefreshRate.Numerator = 1;
+		swapChainDesc.BufferDesc.RefreshRate.Denominator = 60;
+		swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		swapChainDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
+		swapChainDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
+		swapChainDesc.SampleDesc.Count = 1;
+		swapChainDesc.SampleDesc.Quality = 0;
+		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		swapChainDesc.BufferCount = 1;
+		swapChainDesc.Windowed = true;
+		swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+		swapChainDesc.Flags = 0;
+
+		// Get the handle (HWND) from the SDL backbuffer
+		SDL_SysWMinfo sysWMInfo{};
+		SDL_GetVersion(&sysWMInfo.version);
+		SDL_GetWindowWMInfo(m_pWindow, &sysWMInfo);
+		swapChainDesc.OutputWindow = sysWMInfo.info.win.window;
+
+		// Create SwapChain
+		result = pDxgiFactory->CreateSwapChain(m_pDevice, &swapChainDesc, &m_pSwapChain);
+		if (FAILED(result))
+		{
+			std::cout << "failed to index Create Swap Chain" << std::endl;
+			return result;
+		}
+
+		// 3. Create DepthStencil (DS) & DepthStencilView (DSV)
+		// Resource
+		D3D11_TEXTURE2D_DESC depthStencilDesc{};
+		depthStencilDesc.Width = m_Width;
+		depthStencilDesc.Height = m_Height;
+		depthStencilDesc.MipLevels = 1;
+		depthStencilDesc.ArraySize = 1;
+		depthStencilDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		depthStencilDesc.SampleDesc.Count = 1;
+		depthStencilDesc.SampleDesc.Quality = 0;
+		depthStencilDesc.Usage = D3D11_USAGE_DEFAULT;
+		depthStencilDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+		depthStencilDesc.CPUAccessFlags = 0;
+		depthStencilDesc.MiscFlags = 0;
+
+		// View
+		D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc{};
+		depthStencilViewDesc.Format = depthStencilViewDesc.Format;
+		depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+		depthStencilViewDesc.Texture2D.MipSlice = 0;
+
+		result = m_pDevice->CreateTexture2D(&depthStencilDesc, nullptr, &m_pDepthStencilBuffer);
+
+		if (FAILED(result))
+		{
+			std::cout << "failed to index Create Texture2D" << std::endl;
+			return result;
+		}
+
+		result = m_pDevice->CreateDepthStencilView(m_pDepthStencilBuffer, &depthStencilViewDesc, &m_pDepthStencilView);
+
+		if (FAILED(result))
+		{
+			std::cout << "failed to index Create Depth Stencil" << std::endl;
+			return result;
+		}
+
+		// 4. Create RenderTarget (RT) & RenderTargetView (RTV)
+
+		//Resources
+		result = m_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&m_pRenderTargetBuffer));
+
+		if (FAILED(result))
+		{
+			std::cout << "failed to index Create Render Target" << std::endl;
+			return result;
+		}
+
+		// View
+		result = m_pDevice->CreateRenderTargetView(m_pRenderTargetBuffer, nullptr, &m_pRenderTargetView);
+
+		if (FAILED(result))
+		{
+			std::cout << "failed to index Create Render View" << std::endl;
+			return result;
+		}
+
+		// 5. Bind RTV & DSV to Output Merger Stage
+
+		m_pDeviceContext->OMSetRenderTargets(1, &m_pRenderTargetView, m_pDepthStencilView);
+
+		// 6. Set Viewport
+
+		D3D11_VIEWPORT viewport{};
+		viewport.Width = static_cast<float>(m_Width);
 		viewport.Height = static_cast<float>(m_Height);
 		viewport.TopLeftX = 0.f;
 		viewport.TopLeftY = 0.f;
@@ -488,17 +1390,278 @@ namespace dae {
 		return result;
 	}
 
-	void Renderer::VertexTransformationFunction(const std::vector<Vertex>& verticesIn, std::vector<VertexOut>& verticesOut, Mesh& currentMesh) const
+	int Renderer::PrepareVertices()
+	{
+		// Whatever the worker was transforming is complete after this
+		if (m_PendingTransform.valid()) m_PendingTransform.get();
+
+		const int transformBuffer = m_NextTransformBuffer;
+		m_NextTransformBuffer = 1 - transformBuffer;
+		TakeSnapshot(m_FrameSnapshots[transformBuffer]);
+
+		if (!m_IsPipelined || m_ReadyBuffer < 0)
+		{
+			// Not pipelined (or the pipeline is just starting), this frame is transformed and rasterized right away
+			TransformVertices(transformBuffer, true);
+			m_ReadyBuffer = m_IsPipelined ? transformBuffer : -1;
+			return transformBuffer;
+		}
+
+		// Rasterize the previous frame while the worker transforms this one, one frame of latency
+		const int rasterBuffer = m_ReadyBuffer;
+		// The raster stage owns the thread pool meanwhile, so the worker transforms on its own
+		m_PendingTransform = std::async(std::launch::async, [this, transformBuffer] { TransformVertices(transformBuffer, false); });
+		m_ReadyBuffer = transformBuffer;
+
+		return rasterBuffer;
+	}
+
+	void Renderer::TakeSnapshot(FrameSnapshot& snapshot)
+	{
+		snapshot.viewProjectionMatrix = m_Camera.viewMatrix * m_Camera.projectionMatrix;
+		snapshot.cameraOrigin = m_Camera.origin;
+
+		snapshot.worldMatrices.resize(m_pMeshes.size());
+		snapshot.isMeshVisible.resize(m_pMeshes.size());
+		snapshot.frustumPlanes = m_Camera.frustumPlanes;
+		snapshot.isMeshletCulled.resize(m_pMeshes.size());
+		snapshot.cullModes.resize(m_pMeshes.size());
+		snapshot.meshLods = m_MeshLods;
+		for (size_t meshIdx{ 0 }; meshIdx < m_pMeshes.size(); meshIdx++)
+		{
+			snapshot.worldMatrices[meshIdx] = m_pMeshes[meshIdx]->GetWorldMatrix();
+			snapshot.isMeshVisible[meshIdx] = (meshIdx != 1 || m_RenderFireMesh)
+				&& m_pMeshes[meshIdx]->GetBoundingVolumes().IsInFrustum(m_Camera.frustumPlanes, snapshot.worldMatrices[meshIdx]);
+			// Meshlets are built from the triangle list, strips are always processed whole
+			snapshot.isMeshletCulled[meshIdx] = m_IsMeshletCulling && m_pMeshes[meshIdx]->GetPrimitiveTopology() == TriangleList
+				&& !m_pMeshes[meshIdx]->GetMeshlets(snapshot.meshLods[meshIdx]).empty();
+			// Transparent meshes are never back face culled
+			snapshot.cullModes[meshIdx] = m_pMeshes[meshIdx]->GetUsesTransparency() ? NoCull : m_pMeshes[meshIdx]->GetCurrentCullMode();
+		}
+	}
+
+	void Renderer::TransformVertices(int bufferIdx, bool isParallel)
+	{
+		// Can run on the pipeline worker, so only the snapshot is used, never the live camera or meshes' world matrices
+		const FrameSnapshot& snapshot = m_FrameSnapshots[bufferIdx];
+
+		for (size_t meshIdx{ 0 }; meshIdx < m_pMeshes.size(); meshIdx++)
+		{
+			if (!snapshot.isMeshVisible[meshIdx]) continue;
+
+			Mesh* currentMesh = m_pMeshes[meshIdx];
+			const int lodIdx = snapshot.meshLods[meshIdx];
+			const std::vector<uint8_t>* pVertexBlocks{ nullptr };
+
+			if (snapshot.isMeshletCulled[meshIdx])
+			{
+				MeshletVisibility& visibility = currentMesh->GetMeshletVisibility(bufferIdx);
+				CullMeshlets(currentMesh->GetMeshlets(lodIdx), visibility, currentMesh->GetVertices().size(), snapshot, meshIdx);
+				pVertexBlocks = &visibility.vertexBlocks;
+			}
+			else if (lodIdx > 0)
+			{
+				// Simplified levels share the vertex buffer, only the vertices they still use are transformed
+				pVertexBlocks = &currentMesh->GetLodVertexBlocks(lodIdx);
+			}
+
+			VertexTransformationFunction(currentMesh->GetVertices(), currentMesh->GetVertexStreams(), currentMesh->GetOutVertices(bufferIdx),
+				snapshot.worldMatrices[meshIdx], snapshot.viewProjectionMatrix, isParallel, pVertexBlocks);
+		}
+	}
+
+	void Renderer::CullMeshlets(const std::vector<Meshlet>& meshlets, MeshletVisibility& visibility, size_t nrOfVertices,
+		const FrameSnapshot& snapshot, size_t meshIdx)
+	{
+		const Matrix& worldMatrix = snapshot.worldMatrices[meshIdx];
+		const CullModes cullMode = snapshot.cullModes[meshIdx];
+
+		// Front face culling is back face culling with the normals flipped
+		const float coneSign{ cullMode == FrontFaceCull ? -1.f : 1.f };
+		const float scale = std::max(worldMatrix.GetAxisX().Magnitude(), std::max(worldMatrix.GetAxisY().Magnitude(), worldMatrix.GetAxisZ().Magnitude()));
+
+		visibility.meshlets.clear();
+		visibility.vertexBlocks.assign((nrOfVertices + VertexStreams::Padding - 1) / VertexStreams::Padding, 0);
+
+		for (uint32_t meshletIdx{ 0 }; meshletIdx < meshlets.size(); meshletIdx++)
+		{
+			const Meshlet& meshlet = meshlets[meshletIdx];
+			const Vector3 center = worldMatrix.TransformPoint(meshlet.sphereCenter);
+			const float radius = meshlet.sphereRadius * scale;
+
+			const auto isOutsidePlane = [&](const Vector4& plane) { return Vector3::Dot(plane.GetXYZ(), center) + plane.w < -radius; };
+			if (std::any_of(snapshot.frustumPlanes.begin(), snapshot.frustumPlanes.end(), isOutsidePlane)) continue;
+
+			if (cullMode != NoCull && meshlet.hasNormalCone)
+			{
+				// Every triangle faces away from every point of the bounding sphere
+				const Vector3 coneAxis = worldMatrix.TransformVector(meshlet.coneAxis).Normalized() * coneSign;
+				const Vector3 cameraToCenter = center - snapshot.cameraOrigin;
+
+				if (Vector3::Dot(cameraToCenter, coneAxis) >= meshlet.coneCutoff * cameraToCenter.Magnitude() + radius) continue;
+			}
+
+			visibility.meshlets.push_back(meshletIdx);
+			for (uint32_t vertexIdx : meshlet.vertices)
+			{
+				visibility.vertexBlocks[vertexIdx / VertexStreams::Padding] = 1;
+			}
+		}
+	}
+
+	void Renderer::VertexTransformationFunction(const std::vector<Vertex>& verticesIn, const VertexStreams& vertexStreams, std::vector<VertexOut>& verticesOut,
+		const Matrix& worldMatrix, const Matrix& viewProjectionMatrix, bool isParallel, const std::vector<uint8_t>* pVertexBlocks)
 	{
 		verticesOut.resize(verticesIn.size());
 
-		const Matrix worldMatrix = currentMesh.GetWorldMatrix();
+		const Matrix worldViewProjectionMatrix = worldMatrix * viewProjectionMatrix;
+		const int nrOfVertices{ static_cast<int>(verticesIn.size()) };
+
+		// firstVertex is always a multiple of the padding, with meshlet culling only the runs of blocks a visible meshlet uses are transformed
+		const auto transformRange = [&](int firstVertex, int endVertex)
+		{
+			if (pVertexBlocks == nullptr)
+			{
+				TransformVertexRange(verticesIn, vertexStreams, verticesOut, worldMatrix, worldViewProjectionMatrix, firstVertex, endVertex);
+				return;
+			}
+
+			int runStart{ firstVertex };
+			while (runStart < endVertex)
+			{
+				if ((*pVertexBlocks)[runStart / VertexStreams::Padding] == 0)
+				{
+					runStart += VertexStreams::Padding;
+					continue;
+				}
+
+				int runEnd{ runStart };
+				while (runEnd < endVertex && (*pVertexBlocks)[runEnd / VertexStreams::Padding] != 0) runEnd += VertexStreams::Padding;
+
+				TransformVertexRange(verticesIn, vertexStreams, verticesOut, worldMatrix, worldViewProjectionMatrix, runStart, std::min(runEnd, endVertex));
+				runStart = runEnd;
+			}
+		};
+
+		// Small meshes are not worth waking the workers for
+		if (!isParallel || nrOfVertices < ParallelTransformThreshold)
+		{
+			transformRange(0, nrOfVertices);
+			return;
+		}
+
+		// Every chunk writes only its own vertices, so the result does not depend on which thread transforms what
+		const int nrOfChunks{ (nrOfVertices + TransformChunkSize - 1) / TransformChunkSize };
+		m_ThreadPool.ParallelFor(nrOfChunks, [&](int chunkIdx)
+		{
+			const int firstVertex{ chunkIdx * TransformChunkSize };
+			transformRange(firstVertex, std::min(firstVertex + TransformChunkSize, nrOfVertices));
+		});
+	}
+
+	void Renderer::TransformVertexRange(const std::vector<Vertex>& verticesIn, const VertexStreams& vertexStreams, std::vector<VertexOut>& verticesOut,
+		const Matrix& worldMatrix, const Matrix& worldViewProjectionMatrix, int firstVertex, int endVertex) const
+	{
+#if defined(DAE_SIMD_AVX2) || defined(DAE_SIMD_SSE)
+		static_assert(VertexStreams::Padding % Simd::Width == 0, "The vertex streams have to be padded to whole SIMD registers");
+
+		// Every matrix element broadcast once, row r and column c as elements[r][c]
+		struct SimdMatrix
+		{
+			Simd::Float elements[4][4];
+		};
+		const auto broadcast = [](const Matrix& matrix)
+		{
+			SimdMatrix simdMatrix;
+			for (int row{ 0 }; row < 4; row++)
+			for (int column{ 0 }; column < 4; column++)
+			{
+				simdMatrix.elements[row][column] = Simd::Set(matrix[row][column]);
+			}
+			return simdMatrix;
+		};
+
+		const SimdMatrix wvp = broadcast(worldViewProjectionMatrix);
+		const SimdMatrix world = broadcast(worldMatrix);
+
+		// Same order of operations as Matrix::TransformPoint / TransformVector
+		const auto transformVector = [](const SimdMatrix& m, int column, Simd::Float x, Simd::Float y, Simd::Float z)
+		{
+			return Simd::Add(Simd::Add(Simd::Mul(m.elements[0][column], x), Simd::Mul(m.elements[1][column], y)), Simd::Mul(m.elements[2][column], z));
+		};
+		const auto transformPoint = [&](const SimdMatrix& m, int column, Simd::Float x, Simd::Float y, Simd::Float z)
+		{
+			return Simd::Add(transformVector(m, column, x, y, z), m.elements[3][column]);
+		};
+
+		// Lanes are stored here and then written into the VertexOut structs
+		enum Outputs { ClipX, ClipY, ClipZ, ClipW, NdcX, NdcY, NdcZ, NormalX, NormalY, NormalZ, TangentX, TangentY, TangentZ, WorldX, WorldY, WorldZ, NrOfOutputs };
+		alignas(32) float lanes[NrOfOutputs][Simd::Width];
+
+		for (int idx{ firstVertex }; idx < endVertex; idx += Simd::Width)
+		{
+			const Simd::Float x = Simd::Load(&vertexStreams.positionX[idx]);
+			const Simd::Float y = Simd::Load(&vertexStreams.positionY[idx]);
+			const Simd::Float z = Simd::Load(&vertexStreams.positionZ[idx]);
+
+			// Clip space position and the perspective divide
+			const Simd::Float clipW = transformPoint(wvp, 3, x, y, z);
+			const Simd::Float clip[3]{ transformPoint(wvp, 0, x, y, z), transformPoint(wvp, 1, x, y, z), transformPoint(wvp, 2, x, y, z) };
+
+			Simd::Store(lanes[ClipW], clipW);
+			for (int component{ 0 }; component < 3; component++)
+			{
+				Simd::Store(lanes[ClipX + component], clip[component]);
+				Simd::Store(lanes[NdcX + component], Simd::Div(clip[component], clipW));
+				Simd::Store(lanes[WorldX + component], transformPoint(world, component, x, y, z));
+			}
+
+			// Normal and tangent to world space, normalized
+			const auto transformDirection = [&](const std::vector<float>& streamX, const std::vector<float>& streamY, const std::vector<float>& streamZ, int output)
+			{
+				const Simd::Float directionX = Simd::Load(&streamX[idx]);
+				const Simd::Float directionY = Simd::Load(&streamY[idx]);
+				const Simd::Float directionZ = Simd::Load(&streamZ[idx]);
+
+				const Simd::Float transformed[3]{ transformVector(world, 0, directionX, directionY, directionZ),
+					transformVector(world, 1, directionX, directionY, directionZ), transformVector(world, 2, directionX, directionY, directionZ) };
 
-		const Matrix worldViewProjectionMatrix = currentMesh.GetWorldMatrix() * m_Camera.viewMatrix * m_Camera.projectionMatrix;
+				const Simd::Float length = Simd::Sqrt(Simd::Add(Simd::Add(Simd::Mul(transformed[0], transformed[0]),
+					Simd::Mul(transformed[1], transformed[1])), Simd::Mul(transformed[2], transformed[2])));
 
-		for (int idx{}; idx < verticesIn.size(); idx++)
+				for (int component{ 0 }; component < 3; component++)
+				{
+					Simd::Store(lanes[output + component], Simd::Div(transformed[component], length));
+				}
+			};
+
+			transformDirection(vertexStreams.normalX, vertexStreams.normalY, vertexStreams.normalZ, NormalX);
+			transformDirection(vertexStreams.tangentX, vertexStreams.tangentY, vertexStreams.tangentZ, TangentX);
+
+			const int nrOfLanes{ std::min(Simd::Width, endVertex - idx) };
+			for (int lane{ 0 }; lane < nrOfLanes; lane++)
+			{
+				VertexOut& vertexOut = verticesOut[idx + lane];
+				const Vertex& vertexIn = verticesIn[idx + lane];
+
+				vertexOut.ClipPosition = { lanes[ClipX][lane], lanes[ClipY][lane], lanes[ClipZ][lane], lanes[ClipW][lane] };
+				vertexOut.Outcode = ComputeOutcode(vertexOut.ClipPosition);
+				vertexOut.Position = { lanes[NdcX][lane], lanes[NdcY][lane], lanes[NdcZ][lane], lanes[ClipW][lane] };
+
+				vertexOut.UV = vertexIn.UV;
+				vertexOut.Color = vertexIn.Color;
+				vertexOut.Normal = { lanes[NormalX][lane], lanes[NormalY][lane], lanes[NormalZ][lane] };
+				vertexOut.Tangent = { lanes[TangentX][lane], lanes[TangentY][lane], lanes[TangentZ][lane] };
+				vertexOut.WorldPosition = { lanes[WorldX][lane], lanes[WorldY][lane], lanes[WorldZ][lane], 0.f };
+			}
+		}
+#else
+		for (int idx{ firstVertex }; idx < endVertex; idx++)
 		{
-			verticesOut[idx].Position = worldViewProjectionMatrix.TransformPoint(verticesIn[idx].Position.ToPoint4());
+			verticesOut[idx].ClipPosition = worldViewProjectionMatrix.TransformPoint(verticesIn[idx].Position.ToPoint4());
+			verticesOut[idx].Outcode = ComputeOutcode(verticesOut[idx].ClipPosition);
+
+			verticesOut[idx].Position = verticesOut[idx].ClipPosition;
 
 			verticesOut[idx].Position.x /= verticesOut[idx].Position.w;
 			verticesOut[idx].Position.y /= verticesOut[idx].Position.w;
@@ -510,7 +1673,7 @@ namespace dae {
 			verticesOut[idx].Tangent = worldMatrix.TransformVector(verticesIn[idx].Tangent).Normalized();
 			verticesOut[idx].WorldPosition = (worldMatrix.TransformPoint(verticesIn[idx].Position)).ToVector4();
 		}
-
+#endif
 	}
 
 	void Renderer::ConvertToRasterSpace(std::array<Vector4, 3>& triangle) const
@@ -543,57 +1706,133 @@ namespace dae {
 
 			std::cout << ESC << YELLOW_TXT << "m" << "(SHARED) " << "Mesh rotation is" << OnOrOff(m_IsRotating) << RESET << "\n\n";
 		}
-			
+			
+
+		if (keyScancode == SDL_SCANCODE_F3)
+		{
+			m_RenderFireMesh = !m_RenderFireMesh;
+			std::cout << ESC << YELLOW_TXT << "m" << "(SHARED) " << "Fire effect is" << OnOrOff(m_RenderFireMesh) << RESET << "\n\n";
+		}
+			
+
+		if (keyScancode == SDL_SCANCODE_F4)
+		{
+			for (const auto mesh : m_pMeshes)
+			{
+				mesh->ToggleTechnique();
+			}
+
+
+			std::cout << ESC << GREEN_TXT << "m" << "(HARDWARE) " <<"Current Technique is " << m_pMeshes[0]->GetCurrentTechnique() << RESET << "\n\n";
+		}
+
+		if (keyScancode == SDL_SCANCODE_F5)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+
+			m_CurrentRenderMode = static_cast<RenderModes>((m_CurrentRenderMode + 1) % static_cast<int>(RenderModesEnd));
+
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Current Render is " << GetCurrentRenderModeName() << RESET << "\n\n";
+		}
+		if (keyScancode == SDL_SCANCODE_F6)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsNormalMapOn = !m_IsNormalMapOn;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Normal map is" << OnOrOff(m_IsNormalMapOn) << RESET << "\n\n";
+		}
+			
+
+		if (keyScancode == SDL_SCANCODE_F7)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsRenderingDepthBuffer = !m_IsRenderingDepthBuffer;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Rendering Depth Buffer map is" << OnOrOff(m_IsRenderingDepthBuffer) << RESET << "\n\n";
+		}
+			
+
+		if (keyScancode == SDL_SCANCODE_F8)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsBoundingBoxVisualisation = !m_IsBoundingBoxVisualisation;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Bounding Box Visualisation is" << OnOrOff(m_IsBoundingBoxVisualisation) << RESET << "\n\n";
+		}
+			
+
+		if (keyScancode == SDL_SCANCODE_1)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsMultithreaded = !m_IsMultithreaded;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Multithreaded tile rasterization (" << m_ThreadPool.GetNrOfThreads() << " threads) is" << OnOrOff(m_IsMultithreaded) << RESET << "\n\n";
+		}
+
+		if (keyScancode == SDL_SCANCODE_2)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+			m_CurrentRasterKernel = static_cast<RasterKernels>((m_CurrentRasterKernel + 1) % static_cast<int>(RasterKernelsEnd));
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Current Raster Kernel is " << GetCurrentRasterKernelName() << RESET << "\n\n";
+		}
+
+		if (keyScancode == SDL_SCANCODE_3)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsHierarchical = !m_IsHierarchical;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Hierarchical block rasterization is" << OnOrOff(m_IsHierarchical) << RESET << "\n\n";
+		}
 
-		if (keyScancode == SDL_SCANCODE_F3)
+		if (keyScancode == SDL_SCANCODE_4)
 		{
-			m_RenderFireMesh = !m_RenderFireMesh;
-			std::cout << ESC << YELLOW_TXT << "m" << "(SHARED) " << "Fire effect is" << OnOrOff(m_RenderFireMesh) << RESET << "\n\n";
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsDeferredShading = !m_IsDeferredShading;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Deferred (visibility buffer) shading is" << OnOrOff(m_IsDeferredShading) << RESET << "\n\n";
 		}
-			
 
-		if (keyScancode == SDL_SCANCODE_F4)
+		if (keyScancode == SDL_SCANCODE_5)
 		{
-			for (const auto mesh : m_pMeshes)
-			{
-				mesh->ToggleTechnique();
-			}
-
-
-			std::cout << ESC << GREEN_TXT << "m" << "(HARDWARE) " <<"Current Technique is " << m_pMeshes[0]->GetCurrentTechnique() << RESET << "\n\n";
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsHiZ = !m_IsHiZ;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Hierarchical Z (Hi-Z) rejection is" << OnOrOff(m_IsHiZ) << RESET << "\n\n";
 		}
 
-		if (keyScancode == SDL_SCANCODE_F5)
+		if (keyScancode == SDL_SCANCODE_6)
 		{
 			if (!m_IsSoftwareRasterizer) return;
+			m_IsOrderIndependentTransparency = !m_IsOrderIndependentTransparency;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Weighted blended order independent transparency is" << OnOrOff(m_IsOrderIndependentTransparency) << RESET << "\n\n";
+		}
 
-			m_CurrentRenderMode = static_cast<RenderModes>((m_CurrentRenderMode + 1) % static_cast<int>(RenderModesEnd));
+		if (keyScancode == SDL_SCANCODE_7)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsSortingTransparency = !m_IsSortingTransparency;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Back to front sorting of transparent triangles is" << OnOrOff(m_IsSortingTransparency) << RESET << "\n\n";
+		}
 
-			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Current Render is " << GetCurrentRenderModeName() << RESET << "\n\n";
+		if (keyScancode == SDL_SCANCODE_8)
+		{
+			if (!m_IsSoftwareRasterizer) return;
+			m_IsPipelined = !m_IsPipelined;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Pipelined frames (one frame of latency) is" << OnOrOff(m_IsPipelined) << RESET << "\n\n";
 		}
-		if (keyScancode == SDL_SCANCODE_F6)
+
+		if (keyScancode == SDL_SCANCODE_9)
 		{
 			if (!m_IsSoftwareRasterizer) return;
-			m_IsNormalMapOn = !m_IsNormalMapOn;
-			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Normal map is" << OnOrOff(m_IsNormalMapOn) << RESET << "\n\n";
+			m_IsMeshletCulling = !m_IsMeshletCulling;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Meshlet frustum and normal cone culling is" << OnOrOff(m_IsMeshletCulling) << RESET << "\n\n";
 		}
-			
 
-		if (keyScancode == SDL_SCANCODE_F7)
+		if (keyScancode == SDL_SCANCODE_0)
 		{
 			if (!m_IsSoftwareRasterizer) return;
-			m_IsRenderingDepthBuffer = !m_IsRenderingDepthBuffer;
-			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Rendering Depth Buffer map is" << OnOrOff(m_IsRenderingDepthBuffer) << RESET << "\n\n";
+			m_MaxAnisotropy = m_MaxAnisotropy >= TextureGradients::MaxAnisotropy ? 1 : m_MaxAnisotropy * 2;
+			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Max anisotropy is " << m_MaxAnisotropy << "x" << RESET << "\n\n";
 		}
-			
 
-		if (keyScancode == SDL_SCANCODE_F8)
+		if (keyScancode == SDL_SCANCODE_B)
 		{
 			if (!m_IsSoftwareRasterizer) return;
-			m_IsBoundingBoxVisualisation = !m_IsBoundingBoxVisualisation;
-			std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Bounding Box Visualisation is" << OnOrOff(m_IsBoundingBoxVisualisation) << RESET << "\n\n";
+			RunBenchmarks();
 		}
-			
 
 		if (keyScancode == SDL_SCANCODE_F9)
 		{
@@ -605,6 +1844,12 @@ namespace dae {
 			std::cout << ESC << YELLOW_TXT << "m" << "(SHARED) " << "Current CullMode is " << m_pMeshes[0]->GetCurrentCullModeName() << RESET << "\n\n";
 		}
 
+		if (keyScancode == SDL_SCANCODE_L)
+		{
+			m_IsLodSelection = !m_IsLodSelection;
+			std::cout << ESC << YELLOW_TXT << "m" << "(SHARED) " << "LOD selection by screen size is" << OnOrOff(m_IsLodSelection) << RESET << "\n\n";
+		}
+
 		if (keyScancode == SDL_SCANCODE_F10)
 		{
 			m_UniformColor = !m_UniformColor;
@@ -635,6 +1880,412 @@ namespace dae {
 
 	}
 
+	std::string Renderer::GetCurrentRasterKernelName() const
+	{
+		switch (m_CurrentRasterKernel)
+		{
+		case FloatKernel:
+			return "Float Kernel";
+		case FixedPointKernel:
+			return "Fixed Point Kernel";
+		case SimdKernel:
+			return std::string("SIMD Kernel (") + Simd::Name + ")";
+		default:
+			return "Error no raster kernel";
+		}
+	}
+
+	void Renderer::RunBenchmarks()
+	{
+		constexpr int nrOfFrames{ 30 };
+
+		const bool renderFireMesh = m_RenderFireMesh;
+		const RasterKernels rasterKernel = m_CurrentRasterKernel;
+
+		// Only vehicle.obj
+		m_RenderFireMesh = false;
+
+		std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Benchmark raster kernels on vehicle.obj, " << nrOfFrames
+			<< " frames each, multithreaded is" << OnOrOff(m_IsMultithreaded) << RESET << "\n";
+
+		for (int kernelIdx{ 0 }; kernelIdx < RasterKernelsEnd; kernelIdx++)
+		{
+			m_CurrentRasterKernel = static_cast<RasterKernels>(kernelIdx);
+
+			// Warm up
+			RenderSoftware();
+
+			const uint64_t startTime = SDL_GetPerformanceCounter();
+			for (int frame{ 0 }; frame < nrOfFrames; frame++)
+			{
+				RenderSoftware();
+			}
+			const uint64_t endTime = SDL_GetPerformanceCounter();
+
+			const double milliseconds = double(endTime - startTime) * 1000.0 / double(SDL_GetPerformanceFrequency()) / nrOfFrames;
+			std::cout << ESC << PURPLE_TXT << "m" << "	" << GetCurrentRasterKernelName() << ": " << milliseconds << " ms per frame" << RESET << "\n";
+		}
+
+		// Transparent sort time against triangle count, random depths like a particle system
+		constexpr int nrOfSorts{ 20 };
+		std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Benchmark back to front radix sort, " << nrOfSorts
+			<< " sorts each (std::stable_sort for reference)" << RESET << "\n";
+
+		std::mt19937 randomEngine{ 42 };
+		std::uniform_int_distribution<uint32_t> randomKey{ 0, 65535 };
+
+		for (const int nrOfTriangles : { 1'000, 10'000, 50'000, 100'000, 500'000 })
+		{
+			std::vector<uint64_t> unsortedItems(nrOfTriangles);
+			for (int idx{ 0 }; idx < nrOfTriangles; idx++)
+			{
+				unsortedItems[idx] = (uint64_t(randomKey(randomEngine)) << 32) | uint32_t(idx);
+			}
+
+			std::vector<uint64_t> items{};
+			std::vector<uint64_t> scratch{};
+
+			const auto timeSorts = [&](const auto& sort)
+			{
+				const uint64_t startTime = SDL_GetPerformanceCounter();
+				for (int sortIdx{ 0 }; sortIdx < nrOfSorts; sortIdx++)
+				{
+					items = unsortedItems;
+					sort();
+				}
+				const uint64_t endTime = SDL_GetPerformanceCounter();
+
+				return double(endTime - startTime) * 1000.0 / double(SDL_GetPerformanceFrequency()) / nrOfSorts;
+			};
+
+			const double radixMilliseconds = timeSorts([&] { RadixSortByKey(items, scratch); });
+			const double stableSortMilliseconds = timeSorts([&] { std::stable_sort(items.begin(), items.end(),
+				[](uint64_t a, uint64_t b) { return (a >> 32) < (b >> 32); }); });
+
+			std::cout << ESC << PURPLE_TXT << "m" << "	" << nrOfTriangles << " triangles: " << radixMilliseconds << " ms radix sort, "
+				<< stableSortMilliseconds << " ms std::stable_sort" << RESET << "\n";
+		}
+
+		// Pixel conversion, a full screen of colors packed into the back buffer format and unpacked again
+		constexpr int nrOfConversions{ 20 };
+		std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Benchmark pack + unpack of " << m_Width << "x" << m_Height
+			<< " pixels, " << nrOfConversions << " times each" << RESET << "\n";
+
+		const int nrOfPixels{ m_Width * m_Height };
+		std::uniform_real_distribution<float> randomChannel{ 0.f, 1.2f };
+
+		std::vector<ColorRGBA> colors(nrOfPixels);
+		for (ColorRGBA& color : colors)
+		{
+			color = { randomChannel(randomEngine), randomChannel(randomEngine), randomChannel(randomEngine) };
+		}
+
+		std::vector<uint32_t> pixels(nrOfPixels);
+		std::vector<ColorRGBA> unpackedColors(nrOfPixels);
+
+		const auto timeConversions = [&](const auto& convert)
+		{
+			const uint64_t startTime = SDL_GetPerformanceCounter();
+			for (int conversionIdx{ 0 }; conversionIdx < nrOfConversions; conversionIdx++)
+			{
+				convert();
+			}
+			const uint64_t endTime = SDL_GetPerformanceCounter();
+
+			return double(endTime - startTime) * 1000.0 / double(SDL_GetPerformanceFrequency()) / nrOfConversions;
+		};
+
+		const double sdlMilliseconds = timeConversions([&]
+		{
+			const SDL_PixelFormat* pFormat = m_pBackBuffer->format;
+			for (int idx{ 0 }; idx < nrOfPixels; idx++)
+			{
+				ColorRGBA color = colors[idx];
+				color.MaxToOne();
+				pixels[idx] = SDL_MapRGB(pFormat, static_cast<uint8_t>(color.r * 255), static_cast<uint8_t>(color.g * 255), static_cast<uint8_t>(color.b * 255));
+			}
+			for (int idx{ 0 }; idx < nrOfPixels; idx++)
+			{
+				uint8_t r, g, b;
+				SDL_GetRGB(pixels[idx], pFormat, &r, &g, &b);
+				unpackedColors[idx] = { r / 255.f, g / 255.f, b / 255.f };
+			}
+		});
+
+		const double directMilliseconds = timeConversions([&]
+		{
+			PackPixels(colors.data(), pixels.data(), nrOfPixels);
+			UnpackPixels(pixels.data(), unpackedColors.data(), nrOfPixels);
+		});
+
+		std::cout << ESC << PURPLE_TXT << "m" << "	SDL_MapRGB / SDL_GetRGB: " << sdlMilliseconds << " ms, PackPixels / UnpackPixels: "
+			<< directMilliseconds << " ms" << RESET << "\n";
+
+		// Anisotropic filtering against max anisotropy, 16:1 footprints in random directions on the vehicle's diffuse map
+		constexpr int nrOfSamples{ 1'000'000 };
+		std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Benchmark anisotropic sampling of 16:1 footprints, "
+			<< nrOfSamples << " samples each" << RESET << "\n";
+
+		const Texture* pTexture = m_pMeshes[0]->GetMaterialComponentByName(m_DiffuseMapString).pMatCompTexture;
+		std::uniform_real_distribution<float> randomUV{ 0.f, 1.f };
+		std::uniform_real_distribution<float> randomAngle{ 0.f, 2.f * PI };
+
+		std::vector<Vector2> uvs(nrOfSamples);
+		std::vector<TextureGradients> footprints(nrOfSamples);
+		for (int idx{ 0 }; idx < nrOfSamples; idx++)
+		{
+			uvs[idx] = { randomUV(randomEngine), randomUV(randomEngine) };
+
+			const float angle = randomAngle(randomEngine);
+			const Vector2 direction{ std::cos(angle), std::sin(angle) };
+			footprints[idx].uvDerivativeX = direction * (16.f / 1024.f);
+			footprints[idx].uvDerivativeY = Vector2{ -direction.y, direction.x } * (1.f / 1024.f);
+		}
+
+		for (int maxAnisotropy{ 1 }; maxAnisotropy <= TextureGradients::MaxAnisotropy; maxAnisotropy *= 2)
+		{
+			for (TextureGradients& footprint : footprints)
+			{
+				footprint.maxAnisotropy = maxAnisotropy;
+			}
+
+			uint64_t nrOfTaps{};
+			ColorRGBA colorSum{};
+
+			const uint64_t startTime = SDL_GetPerformanceCounter();
+			for (int idx{ 0 }; idx < nrOfSamples; idx++)
+			{
+				colorSum += pTexture->SampleAnisotropic(uvs[idx], footprints[idx], nrOfTaps);
+			}
+			const uint64_t endTime = SDL_GetPerformanceCounter();
+
+			const double nanoseconds = double(endTime - startTime) * 1'000'000'000.0 / double(SDL_GetPerformanceFrequency()) / nrOfSamples;
+			std::cout << ESC << PURPLE_TXT << "m" << "	" << maxAnisotropy << "x: " << nanoseconds << " ns per sample, "
+				<< double(nrOfTaps) / nrOfSamples << " taps per sample (average red " << colorSum.r / nrOfSamples << ")" << RESET << "\n";
+		}
+
+		// Texel layout, the four texels of a bilinear footprint from a row major and a Morton tiled copy of the same texels
+		constexpr int nrOfFootprints{ 4'000'000 };
+		std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Benchmark row major against " << Texture::TileSize << "x" << Texture::TileSize
+			<< " Morton tiled texels, " << nrOfFootprints << " bilinear footprints each" << RESET << "\n";
+
+		for (const int textureSize : { 1024, 4096 })
+		{
+			std::vector<uint32_t> rowMajorTexels(size_t(textureSize) * textureSize);
+			for (uint32_t& texel : rowMajorTexels)
+			{
+				texel = static_cast<uint32_t>(randomEngine());
+			}
+
+			std::vector<uint32_t> tiledTexels(Texture::GetTiledSize(textureSize, textureSize));
+			Texture::TileTexels(rowMajorTexels.data(), textureSize, textureSize, tiledTexels.data());
+
+			const int mask{ textureSize - 1 };
+			const int tilesPerRow{ textureSize / Texture::TileSize };
+
+			const auto rowMajorOffsetX = [](int x) { return size_t(x); };
+			const auto rowMajorOffsetY = [textureSize](int y) { return size_t(y) * textureSize; };
+			const auto tiledOffsetX = [](int x) { return Texture::GetTiledOffsetX(x); };
+			const auto tiledOffsetY = [tilesPerRow](int y) { return Texture::GetTiledOffsetY(y, tilesPerRow); };
+
+			// Addressed like the sampler does, one offset per column and one per row of the footprint
+			const auto timeFootprints = [&](const auto& getPosition, const uint32_t* pTexels, const auto& getOffsetX, const auto& getOffsetY)
+			{
+				uint32_t randomState{ 42 };
+				uint32_t texelSum{};
+
+				const uint64_t startTime = SDL_GetPerformanceCounter();
+				for (int idx{ 0 }; idx < nrOfFootprints; idx++)
+				{
+					int x, y;
+					getPosition(idx, randomState, x, y);
+
+					const uint32_t* pRow0 = pTexels + getOffsetY(y);
+					const uint32_t* pRow1 = pTexels + getOffsetY((y + 1) & mask);
+					const size_t offsetX0 = getOffsetX(x);
+					const size_t offsetX1 = getOffsetX((x + 1) & mask);
+
+					texelSum += pRow0[offsetX0] + pRow0[offsetX1] + pRow1[offsetX0] + pRow1[offsetX1];
+				}
+				const uint64_t endTime = SDL_GetPerformanceCounter();
+
+				// Otherwise the loads could be optimized away
+				volatile uint32_t result{ texelSum };
+				(void)result;
+
+				return double(endTime - startTime) * 1'000'000'000.0 / double(SDL_GetPerformanceFrequency()) / nrOfFootprints;
+			};
+
+			const auto benchmarkPattern = [&](const char* patternName, const auto& getPosition)
+			{
+				const double rowMajorNanoseconds = timeFootprints(getPosition, rowMajorTexels.data(), rowMajorOffsetX, rowMajorOffsetY);
+				const double tiledNanoseconds = timeFootprints(getPosition, tiledTexels.data(), tiledOffsetX, tiledOffsetY);
+
+				std::cout << ESC << PURPLE_TXT << "m" << "	" << textureSize << "x" << textureSize << " " << patternName << ": " << rowMajorNanoseconds
+					<< " ns row major, " << tiledNanoseconds << " ns tiled per footprint" << RESET << "\n";
+			};
+
+			benchmarkPattern("row by row", [&](int idx, uint32_t&, int& x, int& y)
+			{
+				x = idx & mask;
+				y = (idx / textureSize) & mask;
+			});
+
+			// Like a rotated texture, every next row is the next diagonal
+			benchmarkPattern("diagonal", [&](int idx, uint32_t&, int& x, int& y)
+			{
+				x = idx & mask;
+				y = (x + idx / textureSize) & mask;
+			});
+
+			benchmarkPattern("random", [&](int, uint32_t& randomState, int& x, int& y)
+			{
+				// xorshift32, std::mt19937 would cost more than the texel loads
+				randomState ^= randomState << 13;
+				randomState ^= randomState >> 17;
+				randomState ^= randomState << 5;
+				x = randomState & mask;
+				y = (randomState >> 16) & mask;
+			});
+		}
+
+		// Block compression, the vehicle's maps loaded again uncompressed and block compressed, bilinear samples of level 0
+		constexpr int nrOfBilinearSamples{ 1'000'000 };
+		std::cout << ESC << PURPLE_TXT << "m" << "(SOFTWARE) " << "Benchmark uncompressed against block compressed vehicle maps, "
+			<< nrOfBilinearSamples << " bilinear samples each" << RESET << "\n";
+
+		std::vector<Vector2> rowByRowUVs(nrOfBilinearSamples);
+		std::vector<Vector2> randomUVs(nrOfBilinearSamples);
+		for (int idx{ 0 }; idx < nrOfBilinearSamples; idx++)
+		{
+			// Half a texel apart on a 1024x1024 map, like a magnified texture walked by the rasterizer
+			rowByRowUVs[idx] = { float(idx % 2048) / 2048.f, float(idx / 2048) / 2048.f };
+			randomUVs[idx] = { randomUV(randomEngine), randomUV(randomEngine) };
+		}
+
+		const auto timeSamples = [](const Texture& texture, const std::vector<Vector2>& sampleUVs)
+		{
+			// No gradients, so every sample is one bilinear lookup in level 0
+			const TextureGradients gradients{};
+			uint64_t nrOfTaps{};
+			ColorRGBA colorSum{};
+
+			const uint64_t startTime = SDL_GetPerformanceCounter();
+			for (const Vector2& uv : sampleUVs)
+			{
+				colorSum += texture.SampleAnisotropic(uv, gradients, nrOfTaps);
+			}
+			const uint64_t endTime = SDL_GetPerformanceCounter();
+
+			// Otherwise the samples could be optimized away
+			volatile float result{ colorSum.r };
+			(void)result;
+
+			return double(endTime - startTime) * 1'000'000'000.0 / double(SDL_GetPerformanceFrequency()) / double(sampleUVs.size());
+		};
+
+		const std::pair<const char*, TextureUsage> vehicleMaps[]
+		{
+			{ "Resources/vehicle_diffuse.png", TextureUsage::Color },
+			{ "Resources/vehicle_normal.png", TextureUsage::Normal },
+			{ "Resources/vehicle_specular.png", TextureUsage::SingleChannel },
+			{ "Resources/vehicle_gloss.png", TextureUsage::SingleChannel }
+		};
+
+		size_t uncompressedBytes{};
+		size_t compressedBytes{};
+		for (const auto& [path, usage] : vehicleMaps)
+		{
+			Texture uncompressedTexture{};
+			Texture compressedTexture{};
+			uncompressedTexture.LoadFromFile(m_pDevice, path, usage, false);
+			compressedTexture.LoadFromFile(m_pDevice, path, usage, true);
+
+			uncompressedBytes += uncompressedTexture.GetMemorySize();
+			compressedBytes += compressedTexture.GetMemorySize();
+
+			std::cout << ESC << PURPLE_TXT << "m" << "	" << path << ": " << uncompressedTexture.GetMemorySize() / 1024 << " KB -> "
+				<< compressedTexture.GetMemorySize() / 1024 << " KB, row by row " << timeSamples(uncompressedTexture, rowByRowUVs) << " ns -> "
+				<< timeSamples(compressedTexture, rowByRowUVs) << " ns, random " << timeSamples(uncompressedTexture, randomUVs) << " ns -> "
+				<< timeSamples(compressedTexture, randomUVs) << " ns per sample" << RESET << "\n";
+		}
+
+		std::cout << ESC << PURPLE_TXT << "m" << "	Total: " << uncompressedBytes / 1024 << " KB -> " << compressedBytes / 1024 << " KB ("
+			<< 100.0 * double(uncompressedBytes - compressedBytes) / double(uncompressedBytes) << "% saved)" << RESET << "\n";
+
+		std::cout << "\n";
+
+		m_RenderFireMesh = renderFireMesh;
+		m_CurrentRasterKernel = rasterKernel;
+	}
+
+	void Renderer::PrintFrameStats() const
+	{
+		if (!m_IsSoftwareRasterizer) return;
+
+		if (m_IsHierarchical)
+		{
+			const auto printBlockCounters = [](const char* blockName, const BlockCounters& counters)
+			{
+				std::cout << "	" << blockName << " blocks - outside: " << counters.outside
+					<< ", inside: " << counters.inside << ", partial: " << counters.partial << "\n";
+			};
+
+			printBlockCounters("64x64", m_FrameStats.largeBlocks);
+			printBlockCounters("8x8", m_FrameStats.smallBlocks);
+		}
+
+		if (m_IsHiZ)
+		{
+			const auto printHiZCounters = [](const char* blockName, const HiZCounters& counters)
+			{
+				const uint64_t tested = counters.tested;
+				const uint64_t rejected = counters.rejected;
+
+				std::cout << "	Hi-Z " << blockName << " - tested: " << tested << ", rejected: " << rejected
+					<< " (" << (tested > 0 ? 100.0 * rejected / tested : 0.0) << "%)\n";
+			};
+
+			printHiZCounters("tiles", m_FrameStats.hiZTiles);
+			printHiZCounters("8x8 blocks", m_FrameStats.hiZBlocks);
+		}
+
+		if (m_IsLodSelection)
+		{
+			for (size_t meshIdx{ 0 }; meshIdx < m_pMeshes.size(); meshIdx++)
+			{
+				std::cout << "	Mesh " << meshIdx << " - LOD " << m_MeshLods[meshIdx] << " of " << m_pMeshes[meshIdx]->GetNrOfLods()
+					<< ", triangles: " << m_pMeshes[meshIdx]->GetIndices(m_MeshLods[meshIdx]).size() / 3 << "\n";
+			}
+		}
+
+		if (m_IsMeshletCulling)
+		{
+			const uint32_t meshlets = m_FrameStats.meshlets;
+			const uint32_t culledMeshlets = m_FrameStats.culledMeshlets;
+
+			std::cout << "	Meshlets - total: " << meshlets << ", culled: " << culledMeshlets
+				<< " (" << (meshlets > 0 ? 100.0 * culledMeshlets / meshlets : 0.0) << "%)\n";
+		}
+
+		if (std::strcmp(m_pMeshes[0]->GetCurrentTechnique(), "AnisotropicTechnique") == 0)
+		{
+			const uint64_t sampleTaps = m_FrameStats.sampleTaps;
+
+			std::cout << "	Anisotropic filtering - max " << m_MaxAnisotropy << "x, this frame " << m_FrameAnisotropy << "x, taps: " << sampleTaps
+				<< " of " << m_SampleTapBudget << "\n";
+		}
+
+		if (m_IsDeferredShading)
+		{
+			const uint64_t visibilityFragments = m_FrameStats.visibilityFragments;
+			const uint64_t shadedPixels = m_FrameStats.shadedPixels;
+
+			std::cout << "	Deferred shading - opaque fragments: " << visibilityFragments << ", shaded pixels: " << shadedPixels
+				<< ", shading invocations saved: " << visibilityFragments - shadedPixels << "\n";
+		}
+	}
+
 	std::string Renderer::OnOrOff(bool trueOrFalse)
 	{
 		if (trueOrFalse) return std::string(" ON ");
@@ -660,79 +2311,283 @@ namespace dae {
 		maxX = static_cast<int>(std::ceil(std::max({ v0.x, v1.x, v2.x })));
 		maxY = static_cast<int>(std::ceil(std::max({ v0.y, v1.y, v2.y })));
 
-		minX = std::clamp(minX, 0, m_Width - 1);
-		minY = std::clamp(minY, 0, m_Height - 1);
-		maxX = std::clamp(maxX, 0, m_Width - 1);
-		maxY = std::clamp(maxY, 0, m_Height - 1);
+		// maxX and maxY are exclusive
+		minX = std::clamp(minX, 0, m_Width);
+		minY = std::clamp(minY, 0, m_Height);
+		maxX = std::clamp(maxX, 0, m_Width);
+		maxY = std::clamp(maxY, 0, m_Height);
 
 	}
 
-	bool Renderer::IsInFrustum(std::array<Vector4, 3>& triangle)
+	uint16_t Renderer::ComputeOutcode(const Vector4& clipPosition)
 	{
-		for (int idx{ 0 }; idx < 3; idx++)
+		const float x = clipPosition.x;
+		const float y = clipPosition.y;
+		const float z = clipPosition.z;
+		const float w = clipPosition.w;
+
+		const float guardBandW = GuardBandScale * w;
+
+		uint16_t outcode{};
+
+		if (x < -w) outcode |= OutcodeLeft;
+		if (x > w) outcode |= OutcodeRight;
+		if (y < -w) outcode |= OutcodeBottom;
+		if (y > w) outcode |= OutcodeTop;
+		if (z < 0) outcode |= OutcodeNear;
+		if (z > w) outcode |= OutcodeFar;
+
+		if (x < -guardBandW) outcode |= OutcodeGuardBandLeft;
+		if (x > guardBandW) outcode |= OutcodeGuardBandRight;
+		if (y < -guardBandW) outcode |= OutcodeGuardBandBottom;
+		if (y > guardBandW) outcode |= OutcodeGuardBandTop;
+
+		return outcode;
+	}
+
+	int Renderer::ClipPolygon(std::array<VertexOut, 9>& polygon, int nrOfVertices, uint16_t clipPlanes)
+	{
+		// Signed distance to a clip plane in homogeneous clip space, inside is >= 0
+		const auto distanceToPlane = [](const Vector4& clipPosition, uint16_t plane)
 		{
-			if (triangle[idx].x < -1 || triangle[idx].x > 1)
+			const float guardBandW = GuardBandScale * clipPosition.w;
+
+			switch (plane)
 			{
-				return false;
+			case OutcodeNear:
+				return clipPosition.z;
+			case OutcodeGuardBandLeft:
+				return clipPosition.x + guardBandW;
+			case OutcodeGuardBandRight:
+				return guardBandW - clipPosition.x;
+			case OutcodeGuardBandBottom:
+				return clipPosition.y + guardBandW;
+			case OutcodeGuardBandTop:
+				return guardBandW - clipPosition.y;
+			default:
+				return 0.f;
 			}
+		};
+
+		// Everything is linear in clip space, so attributes can be interpolated before the perspective divide
+		const auto lerpVertex = [](const VertexOut& from, const VertexOut& to, float factor)
+		{
+			VertexOut vertex{};
+			vertex.ClipPosition = from.ClipPosition + (to.ClipPosition - from.ClipPosition) * factor;
+			vertex.Color = from.Color + (to.Color - from.Color) * factor;
+			vertex.UV = from.UV + (to.UV - from.UV) * factor;
+			vertex.Normal = from.Normal + (to.Normal - from.Normal) * factor;
+			vertex.Tangent = from.Tangent + (to.Tangent - from.Tangent) * factor;
+			vertex.WorldPosition = from.WorldPosition + (to.WorldPosition - from.WorldPosition) * factor;
+			return vertex;
+		};
+
+		std::array<VertexOut, 9> clipped{};
+
+		// Sutherland-Hodgman, one plane at a time
+		for (const uint16_t plane : { OutcodeNear, OutcodeGuardBandLeft, OutcodeGuardBandRight, OutcodeGuardBandBottom, OutcodeGuardBandTop })
+		{
+			if (!(clipPlanes & plane)) continue;
 
-			if (triangle[idx].y < -1 || triangle[idx].y > 1)
+			int nrOfClippedVertices{ 0 };
+
+			for (int idx{ 0 }; idx < nrOfVertices; idx++)
 			{
-				return false;
+				const VertexOut& current = polygon[idx];
+				const VertexOut& next = polygon[(idx + 1) % nrOfVertices];
+
+				const float currentDistance = distanceToPlane(current.ClipPosition, plane);
+				const float nextDistance = distanceToPlane(next.ClipPosition, plane);
+
+				if (currentDistance >= 0) clipped[nrOfClippedVertices++] = current;
+
+				if ((currentDistance >= 0) != (nextDistance >= 0))
+				{
+					clipped[nrOfClippedVertices++] = lerpVertex(current, next, currentDistance / (currentDistance - nextDistance));
+				}
 			}
 
-			if (triangle[idx].z < 0 || triangle[idx].z > 1)
+			polygon = clipped;
+			nrOfVertices = nrOfClippedVertices;
+
+			if (nrOfVertices < 3) return 0;
+		}
+
+		for (int idx{ 0 }; idx < nrOfVertices; idx++)
+		{
+			VertexOut& vertex = polygon[idx];
+			const float w = vertex.ClipPosition.w;
+			vertex.Position = { vertex.ClipPosition.x / w, vertex.ClipPosition.y / w, vertex.ClipPosition.z / w, w };
+		}
+
+		return nrOfVertices;
+	}
+
+	void Renderer::AddRasterTriangle(Mesh* currentMesh, CullModes cullMode, int triangleIdx, const std::array<const VertexOut*, 3>& vertices)
+	{
+		RasterTriangle rasterTriangle{};
+		rasterTriangle.pMesh = currentMesh;
+		rasterTriangle.triangleIdx = triangleIdx;
+		rasterTriangle.usesTransparency = currentMesh->GetUsesTransparency();
+		rasterTriangle.vertices = { vertices[0]->Position, vertices[1]->Position, vertices[2]->Position };
+
+		ConvertToRasterSpace(rasterTriangle.vertices);
+
+		if (!SetupTriangle(rasterTriangle, cullMode, vertices)) return;
+
+		// Only clamps to the screen, the guard band keeps the coordinates small enough for the raster kernels
+		CalculateBoundingBox(rasterTriangle.minX, rasterTriangle.minY, rasterTriangle.maxX, rasterTriangle.maxY, rasterTriangle.vertices);
+
+		// Empty bounding box, no pixel can ever be covered
+		if (rasterTriangle.minX >= rasterTriangle.maxX || rasterTriangle.minY >= rasterTriangle.maxY) return;
+
+		m_RasterTriangles.push_back(rasterTriangle);
+	}
+
+	bool Renderer::SetupTriangle(RasterTriangle& rasterTriangle, CullModes cullMode, const std::array<const VertexOut*, 3>& vertices)
+	{
+		const std::array<Vector4, 3>& triangle = rasterTriangle.vertices;
+
+		const Vector2 a{ triangle[0].GetXY(), triangle[1].GetXY() };
+		const Vector2 b{ triangle[1].GetXY(), triangle[2].GetXY() };
+
+		const float triangleArea = Vector2::Cross(a, b);
+		if (triangleArea == 0) return false;
+
+		// Transparent meshes are always NoCull
+		if (triangleArea < 0 && cullMode == BackFaceCull)
+			return false;
+
+		if (triangleArea > 0 && cullMode == FrontFaceCull)
+			return false;
+
+		const float invTriangleArea = 1.f / triangleArea;
+
+		// weight i = Cross(start - P, end - start) / area, with start and end the vertices of the edge opposite to vertex i
+		for (int idx{ 0 }; idx < 3; idx++)
+		{
+			const Vector4& start = triangle[(idx + 1) % 3];
+			const Vector4& end = triangle[(idx + 2) % 3];
+			const Vector2 edge{ start.GetXY(), end.GetXY() };
+
+			rasterTriangle.weights[idx].dx = -edge.y * invTriangleArea;
+			rasterTriangle.weights[idx].dy = edge.x * invTriangleArea;
+			rasterTriangle.weights[idx].c = (start.x * edge.y - start.y * edge.x) * invTriangleArea;
+		}
+
+		// Any value that is linear in screen space becomes a plane: sum of weight i * value i
+		const auto makePlane = [&rasterTriangle](float value0, float value1, float value2)
+		{
+			const auto& weights = rasterTriangle.weights;
+			return PlaneEquation{
+				weights[0].dx * value0 + weights[1].dx * value1 + weights[2].dx * value2,
+				weights[0].dy * value0 + weights[1].dy * value1 + weights[2].dy * value2,
+				weights[0].c * value0 + weights[1].c * value1 + weights[2].c * value2
+			};
+		};
+
+		const std::array<float, 3> invW{ 1.f / triangle[0].w, 1.f / triangle[1].w, 1.f / triangle[2].w };
+
+		// z / w is affine in screen space, so depth is interpolated without perspective correction
+		rasterTriangle.depth = makePlane(triangle[0].z, triangle[1].z, triangle[2].z);
+		rasterTriangle.minDepth = std::min({ triangle[0].z, triangle[1].z, triangle[2].z });
+		rasterTriangle.invW = makePlane(invW[0], invW[1], invW[2]);
+
+		const auto makeAttributePlanes = [&](int attributeIdx, const auto& value0, const auto& value1, const auto& value2, int nrOfComponents)
+		{
+			for (int component{ 0 }; component < nrOfComponents; component++)
 			{
-				return false;
+				rasterTriangle.attributes[attributeIdx + component] = makePlane(
+					value0[component] * invW[0],
+					value1[component] * invW[1],
+					value2[component] * invW[2]);
 			}
+		};
 
-		}
+		makeAttributePlanes(AttributeUV, vertices[0]->UV, vertices[1]->UV, vertices[2]->UV, 2);
+		makeAttributePlanes(AttributeNormal, vertices[0]->Normal, vertices[1]->Normal, vertices[2]->Normal, 3);
+		makeAttributePlanes(AttributeTangent, vertices[0]->Tangent, vertices[1]->Tangent, vertices[2]->Tangent, 3);
+		makeAttributePlanes(AttributeWorldPosition, vertices[0]->WorldPosition, vertices[1]->WorldPosition, vertices[2]->WorldPosition, 3);
+
+		SetupFixedPointEdges(rasterTriangle);
 
 		return true;
 	}
 
-	void Renderer::InterpolateValues(VertexOut& interpolatedValues, const std::array<Vector4, 3>& triangle, 
-		Mesh& currentMesh, const float wInterpolated, int idx, const std::array<float, 3> weights)
+	void Renderer::SetupFixedPointEdges(RasterTriangle& rasterTriangle)
 	{
-		const auto& indices = currentMesh.GetIndices();
-		const auto& outVertices = currentMesh.GetOutVertices();
-		if (currentMesh.GetPrimitiveTopology() == PrimitiveTopology::TriangleList) idx *= 3;
+		const std::array<Vector4, 3>& triangle = rasterTriangle.vertices;
+
+		std::array<int64_t, 3> snappedX{};
+		std::array<int64_t, 3> snappedY{};
+
+		for (int idx{ 0 }; idx < 3; idx++)
+		{
+			snappedX[idx] = std::llround(triangle[idx].x * SubPixelScale);
+			snappedY[idx] = std::llround(triangle[idx].y * SubPixelScale);
+		}
+
+		const int64_t doubleArea = (snappedX[1] - snappedX[0]) * (snappedY[2] - snappedY[1]) -
+			(snappedY[1] - snappedY[0]) * (snappedX[2] - snappedX[1]);
+
+		// Collapsed after snapping, nothing can be covered
+		if (doubleArea == 0)
+		{
+			for (auto& edge : rasterTriangle.fixedPointEdges)
+			{
+				edge = FixedPointEdge{ 0, 0, -1 };
+			}
+			return;
+		}
 
-		const int indice0 = indices[idx];
-		const int indice1 = indices[idx + 1];
-		const int indice2 = indices[idx + 2];
+		// Same edges as the float weights, flipped when needed so the inside is always positive
+		const int64_t orientation = doubleArea > 0 ? 1 : -1;
 
-		interpolatedValues.UV = ((outVertices[indice0].UV / triangle[0].w) * weights[0] +
-			(outVertices[indice1].UV / triangle[1].w) * weights[1] +
-			(outVertices[indice2].UV / triangle[2].w) * weights[2]) * wInterpolated;
+		for (int idx{ 0 }; idx < 3; idx++)
+		{
+			const int start = (idx + 1) % 3;
+			const int end = (idx + 2) % 3;
+
+			FixedPointEdge& edge = rasterTriangle.fixedPointEdges[idx];
+			edge.a = (snappedY[start] - snappedY[end]) * orientation;
+			edge.b = (snappedX[end] - snappedX[start]) * orientation;
+			edge.c = (snappedX[start] * snappedY[end] - snappedY[start] * snappedX[end]) * orientation;
+
+			// Top-left rule: pixels exactly on an edge (value 0) only belong to the triangle if that edge is a left edge
+			// (inside is to the right) or a horizontal top edge (inside is below), so shared edges are drawn once
+			const bool isTopLeft = edge.a > 0 || (edge.a == 0 && edge.b > 0);
+			edge.c -= isTopLeft ? 0 : 1;
+		}
+	}
 
-		interpolatedValues.Normal = ((outVertices[indice0].Normal / triangle[0].w) * weights[0] +
-			(outVertices[indice1].Normal / triangle[1].w) * weights[1] +
-			(outVertices[indice2].Normal / triangle[2].w) * weights[2]) * wInterpolated;
+	void Renderer::InterpolateValues(VertexOut& interpolatedValues, const RasterTriangle& rasterTriangle, 
+		const float x, const float y, const float wInterpolated)
+	{
+		const auto& attributes = rasterTriangle.attributes;
+		const auto interpolate = [&](int attributeIdx)
+		{
+			return attributes[attributeIdx].Evaluate(x, y) * wInterpolated;
+		};
 
-		interpolatedValues.Tangent = ((outVertices[indice0].Tangent / triangle[0].w) * weights[0] +
-			(outVertices[indice1].Tangent / triangle[1].w) * weights[1] +
-			(outVertices[indice2].Tangent / triangle[2].w) * weights[2]) * wInterpolated;
+		interpolatedValues.UV = { interpolate(AttributeUV), interpolate(AttributeUV + 1) };
 
-		interpolatedValues.WorldPosition = ((outVertices[indice0].WorldPosition / triangle[0].w) * weights[0] +
-			(outVertices[indice1].WorldPosition / triangle[1].w) * weights[1] +
-			(outVertices[indice2].WorldPosition / triangle[2].w) * weights[2]) * wInterpolated;
+		interpolatedValues.Normal = { interpolate(AttributeNormal), interpolate(AttributeNormal + 1), interpolate(AttributeNormal + 2) };
 
-		interpolatedValues.Position = ((outVertices[indice0].Position / triangle[0].w) * weights[0] +
-			(outVertices[indice1].Position / triangle[1].w) * weights[1] +
-			(outVertices[indice2].Position / triangle[2].w) * weights[2]) * wInterpolated;
+		interpolatedValues.Tangent = { interpolate(AttributeTangent), interpolate(AttributeTangent + 1), interpolate(AttributeTangent + 2) };
 
+		interpolatedValues.WorldPosition = { interpolate(AttributeWorldPosition), interpolate(AttributeWorldPosition + 1), interpolate(AttributeWorldPosition + 2), 0 };
 
+		interpolatedValues.Position = { x, y, 0, wInterpolated };
 	}
 
-	ColorRGBA Renderer::PixelShading(const VertexOut& v, const Mesh* currentMesh) const
+	ColorRGBA Renderer::PixelShading(const VertexOut& v, const TextureGradients& gradients, const Mesh* currentMesh) const
 	{
 		constexpr ColorRGBA ambient{ .025f,.025f,.025f };
 		const Vector3 lightDirection = { .577f,-.577f,.577f };
 
 		constexpr float kd = 7.f;
 
-		const ColorRGBA cd = currentMesh->GetMaterialComponentByName(m_DiffuseMapString).pMatCompTexture->Sample(v.UV,currentMesh);
+		const ColorRGBA cd = currentMesh->GetMaterialComponentByName(m_DiffuseMapString).pMatCompTexture->Sample(v.UV, gradients, currentMesh, t_SampleTaps);
 
 		// Grabs the Normal colors of the Normal map and then converts it to a usable format
 		Vector3 normalMap { v.Normal};
@@ -741,7 +2596,7 @@ namespace dae {
 		{
 			if (currentMesh->HasMaterialByComponentName(m_NormalMapString))
 			{
-				ColorRGBA normalMapColor = currentMesh->GetMaterialComponentByName(m_NormalMapString).pMatCompTexture->Sample(v.UV, currentMesh);
+				ColorRGBA normalMapColor = currentMesh->GetMaterialComponentByName(m_NormalMapString).pMatCompTexture->Sample(v.UV, gradients, currentMesh, t_SampleTaps);
 				const auto tangent = v.Tangent.Normalized();
 				const auto normal = v.Normal.Normalized();
 				const Vector3 binormal = Vector3::Cross(normal, tangent);
@@ -760,22 +2615,20 @@ namespace dae {
 		if (currentMesh->HasMaterialByComponentName(m_SpecularMapString) && 
 			currentMesh->HasMaterialByComponentName(m_GlossinessMapString))
 		{
-			const ColorRGBA specularMapColor = currentMesh->GetMaterialComponentByName(m_SpecularMapString).pMatCompTexture->Sample(v.UV, currentMesh);
+			const ColorRGBA specularMapColor = currentMesh->GetMaterialComponentByName(m_SpecularMapString).pMatCompTexture->Sample(v.UV, gradients, currentMesh, t_SampleTaps);
 			constexpr float shininess = 25.f;
 
-			const ColorRGBA glossMapColor = currentMesh->GetMaterialComponentByName(m_GlossinessMapString).pMatCompTexture->Sample(v.UV,currentMesh);
+			const ColorRGBA glossMapColor = currentMesh->GetMaterialComponentByName(m_GlossinessMapString).pMatCompTexture->Sample(v.UV, gradients, currentMesh, t_SampleTaps);
 
 
 			const Vector3 reflect = Vector3::Reflect(-lightDirection, normalMap);
-			const Vector3 invViewDirection = (m_Camera.origin - v.WorldPosition.GetXYZ()).Normalized();
+			const Vector3 invViewDirection = (m_ShadingCameraOrigin - v.WorldPosition.GetXYZ()).Normalized();
 			const float cosa{ std::max(Vector3::Dot(reflect, -invViewDirection), 0.f) };
 
 			phongSpecReflect = ColorRGBA{ 1,1,1 } *specularMapColor.r * (std::pow(cosa, glossMapColor.r * shininess));
 		}
 
 
-		if (currentMesh->GetUsesTransparency()) return cd; // if mesh has trasnparency just return pixel color
-
 		if (observedArea < 0) return ColorRGBA{ 0,0,0,1 };
 		
 
@@ -1,9 +1,14 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <future>
 #include <unordered_map>
 
 #include "Camera.h"
 #include "Effects.h"
 #include "Mesh.h"
+#include "Texture.h"
+#include "ThreadPool.h"
 
 #include <stdlib.h>
 
@@ -13,6 +18,153 @@ struct SDL_Surface;
 
 namespace dae
 {
+	// value(x, y) = dx * x + dy * y + c, evaluated in raster space
+	struct PlaneEquation
+	{
+		float dx{};
+		float dy{};
+		float c{};
+
+		float Evaluate(float x, float y) const
+		{
+			return dx * x + dy * y + c;
+		}
+	};
+
+	// Offsets of the perspective correct attributes in RasterTriangle::attributes
+	enum TriangleAttributes
+	{
+		AttributeUV = 0,
+		AttributeNormal = 2,
+		AttributeTangent = 5,
+		AttributeWorldPosition = 8,
+		NrOfTriangleAttributes = 11
+	};
+
+	// Vertices are snapped to 1/256th of a pixel for the fixed point kernel
+	constexpr int SubPixelBits{ 8 };
+	constexpr int SubPixelScale{ 1 << SubPixelBits };
+
+	// value(x, y) = a * x + b * y + c, with x and y in sub pixels, the fill rule bias is already in c so covered means >= 0
+	struct FixedPointEdge
+	{
+		int64_t a{};
+		int64_t b{};
+		int64_t c{};
+
+		int64_t Evaluate(int64_t x, int64_t y) const
+		{
+			return a * x + b * y + c;
+		}
+	};
+
+	enum BlockCoverage
+	{
+		BlockOutside,
+		BlockInside,
+		BlockPartial
+	};
+
+	// A triangle that survived the frustum test and culling, already in raster space
+	struct RasterTriangle
+	{
+		Mesh* pMesh{};
+		int triangleIdx{};
+		std::array<Vector4, 3> vertices{};
+		bool usesTransparency{};
+
+		int minX{};
+		int minY{};
+		int maxX{};
+		int maxY{};
+
+		// Triangle setup, done once per triangle so the pixel loop only has to evaluate these
+		std::array<PlaneEquation, 3> weights{};
+		PlaneEquation depth{};
+		float minDepth{}; // closest vertex, nothing in the triangle is in front of it
+		PlaneEquation invW{};
+		std::array<PlaneEquation, NrOfTriangleAttributes> attributes{}; // attribute / w
+		std::array<FixedPointEdge, 3> fixedPointEdges{};
+	};
+
+	// Counters can be bumped from the raster workers, so they are atomic
+	struct BlockCounters
+	{
+		std::atomic<uint64_t> outside{};
+		std::atomic<uint64_t> inside{};
+		std::atomic<uint64_t> partial{};
+
+		void Reset()
+		{
+			outside = 0;
+			inside = 0;
+			partial = 0;
+		}
+	};
+
+	struct HiZCounters
+	{
+		std::atomic<uint64_t> tested{};
+		std::atomic<uint64_t> rejected{};
+
+		void Reset()
+		{
+			tested = 0;
+			rejected = 0;
+		}
+	};
+
+	struct SoftwareFrameStats
+	{
+		BlockCounters largeBlocks{};
+		BlockCounters smallBlocks{};
+
+		// Hi-Z: triangle vs tile and triangle vs 8x8 block depth tests
+		HiZCounters hiZTiles{};
+		HiZCounters hiZBlocks{};
+
+		// Deferred shading: fragments that passed the depth test in the visibility pass vs pixels that got shaded
+		std::atomic<uint64_t> visibilityFragments{};
+		std::atomic<uint64_t> shadedPixels{};
+
+		// Meshlet culling, of the meshes that were culled per meshlet
+		uint32_t meshlets{};
+		uint32_t culledMeshlets{};
+
+		// Texture lookups of the shaded pixels
+		std::atomic<uint64_t> sampleTaps{};
+
+		void Reset()
+		{
+			largeBlocks.Reset();
+			smallBlocks.Reset();
+			hiZTiles.Reset();
+			hiZBlocks.Reset();
+			visibilityFragments = 0;
+			shadedPixels = 0;
+			meshlets = 0;
+			culledMeshlets = 0;
+			sampleTaps = 0;
+		}
+	};
+
+	// Everything the vertex stage needs, copied after Update so it can run while the previous frame is rasterized
+	struct FrameSnapshot
+	{
+		Matrix viewProjectionMatrix{};
+		Vector3 cameraOrigin{};
+		std::vector<Matrix> worldMatrices{};
+		// Fire mesh toggle and frustum culling, meshes that are not visible are neither transformed nor rasterized
+		std::vector<bool> isMeshVisible{};
+		std::vector<int> meshLods{};
+
+		// Meshlet culling: world space frustum planes and, per mesh, whether it is culled per meshlet.
+		// The cull mode is used for the meshlets and for the triangles, so a toggle never splits a frame
+		std::array<Vector4, 6> frustumPlanes{};
+		std::vector<bool> isMeshletCulled{};
+		std::vector<CullModes> cullModes{};
+	};
+
 	class Renderer final
 	{
 	public:
@@ -25,18 +177,62 @@ namespace dae
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
 		void Update(Timer* pTimer);
-		void Render() const;
+		void SelectLods();
+		void Render();
+		void RenderSoftware();
+		void RenderHardware() const;
+		void RunBenchmarks();
+		void PrintFrameStats() const;
 
 		bool SaveBufferToImage() const;
 		void CalculateBoundingBox(int& minX, int& minY, int& maxX, int& maxY, const std::array<Vector4, 3>& triangle) const;
-		static bool IsInFrustum(std::array<Vector4, 3>& triangle);
-		static void InterpolateValues(VertexOut& interpolatedValues, const std::array<Vector4, 3>& triangle, Mesh& currentMesh, float wInterpolated, int idx, std::array<float, 3> weights);
-		ColorRGBA PixelShading(const VertexOut& v, const Mesh* currentMesh) const;
+		static uint16_t ComputeOutcode(const Vector4& clipPosition);
+		static int ClipPolygon(std::array<VertexOut, 9>& polygon, int nrOfVertices, uint16_t clipPlanes);
+		void AddRasterTriangle(Mesh* currentMesh, CullModes cullMode, int triangleIdx, const std::array<const VertexOut*, 3>& vertices);
+		static bool SetupTriangle(RasterTriangle& rasterTriangle, CullModes cullMode, const std::array<const VertexOut*, 3>& vertices);
+		static void InterpolateValues(VertexOut& interpolatedValues, const RasterTriangle& rasterTriangle, float x, float y, float wInterpolated);
+		ColorRGBA PixelShading(const VertexOut& v, const TextureGradients& gradients, const Mesh* currentMesh) const;
 
-		void VertexTransformationFunction(const std::vector<Vertex>& verticesIn, std::vector<VertexOut>& verticesOut, Mesh& currentMesh) const;
+		void BuildDrawOrder();
+		void BinTriangles();
+		void RasterizeTile(int tileIdx) const;
+		void GetTileBounds(int tileIdx, int& minX, int& minY, int& maxX, int& maxY) const;
+		void ClearTile(int tileIdx) const;
+		void FillUntouchedTiles();
+		void RasterizeTriangle(const RasterTriangle& rasterTriangle, int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const;
+		void RasterizeBlocks(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY, int blockSize) const;
+		void RasterizeWithKernel(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const;
+		BlockCoverage ClassifyBlock(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const;
+		bool IsOccludedByHiZ(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY, int blockSize) const;
+		void UpdateHiZBlocks(int startX, int startY, int endX, int endY) const;
+		void UpdateHiZTiles(int startX, int startY, int endX, int endY) const;
+		void RasterizeBoundingBox(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const;
+		void RasterizeTriangleFloat(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const;
+		void RasterizeTriangleFixedPoint(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const;
+		void RasterizeTriangleSimd(const RasterTriangle& rasterTriangle, int startX, int startY, int endX, int endY) const;
+		void ShadePixel(const RasterTriangle& rasterTriangle, int px, int py) const;
+		ColorRGBA ShadeFragment(const RasterTriangle& rasterTriangle, float pixelX, float pixelY, float ZInterpolated) const;
+		static TextureGradients ComputeTextureGradients(const RasterTriangle& rasterTriangle, float pixelX, float pixelY);
+		void BlendPixel(int pixelIdx, ColorRGBA finalColor) const;
+		void ResolveVisibility(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const;
+		void AccumulateTransparentFragment(int pixelIdx, const ColorRGBA& color, float viewDepth) const;
+		void ResolveTransparency(int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const;
+		void RasterizeRegion(const std::vector<uint32_t>& triangleIndices, int regionMinX, int regionMinY, int regionMaxX, int regionMaxY) const;
+		static void SetupFixedPointEdges(RasterTriangle& rasterTriangle);
+
+		int PrepareVertices();
+		void TakeSnapshot(FrameSnapshot& snapshot);
+		void TransformVertices(int bufferIdx, bool isParallel);
+		static void CullMeshlets(const std::vector<Meshlet>& meshlets, MeshletVisibility& visibility, size_t nrOfVertices,
+			const FrameSnapshot& snapshot, size_t meshIdx);
+		void VertexTransformationFunction(const std::vector<Vertex>& verticesIn, const VertexStreams& vertexStreams, std::vector<VertexOut>& verticesOut,
+			const Matrix& worldMatrix, const Matrix& viewProjectionMatrix, bool isParallel, const std::vector<uint8_t>* pVertexBlocks = nullptr);
+		void TransformVertexRange(const std::vector<Vertex>& verticesIn, const VertexStreams& vertexStreams, std::vector<VertexOut>& verticesOut,
+			const Matrix& worldMatrix, const Matrix& worldViewProjectionMatrix, int firstVertex, int endVertex) const;
 		void ConvertToRasterSpace(std::array<Vector4, 3>& vertices) const;
 		void ToggleOptions(SDL_Scancode keyScancode);
 		std::string GetCurrentRenderModeName() const;
+		std::string GetCurrentRasterKernelName() const;
 		static std::string OnOrOff(bool trueOrFalse);
 
 	private:
@@ -51,6 +247,12 @@ namespace dae
 
 		float* m_pDepthBufferPixels{};
 
+		// Hi-Z: conservative farthest depth per 8x8 block and per 64x64 tile, only kept up to date by opaque triangles
+		float* m_pHiZBlockDepths{};
+		float* m_pHiZTileDepths{};
+		int m_NrOfHiZBlocksX{};
+		int m_NrOfHiZBlocksY{};
+
 		enum RenderModes 
 		{
 			ObservedArea,
@@ -62,14 +264,98 @@ namespace dae
 
 		RenderModes m_CurrentRenderMode{ Combined };
 
+		enum RasterKernels
+		{
+			FloatKernel,
+			FixedPointKernel,
+			SimdKernel,
+			RasterKernelsEnd
+		};
+
+		RasterKernels m_CurrentRasterKernel{ FloatKernel };
+
 		bool m_IsNormalMapOn{ true };
 		bool m_IsRenderingDepthBuffer{};
 		bool m_IsBoundingBoxVisualisation{};
 		bool m_UniformColor{};
 		bool m_RenderFireMesh{true};
 
+		bool m_IsMultithreaded{};
+		bool m_IsHierarchical{};
+		bool m_IsDeferredShading{};
+		bool m_IsHiZ{};
+		bool m_IsOrderIndependentTransparency{};
+		bool m_IsSortingTransparency{};
+		bool m_IsPipelined{};
+		bool m_IsMeshletCulling{};
+		bool m_IsLodSelection{};
+
+		// LOD i + 1 is used once the mesh' bounding sphere is less than m_LodScreenSizes[i] pixels high on screen.
+		// With hysteresis the size has to get that fraction past a threshold before the LOD switches, so it does not pop back and forth
+		std::vector<float> m_LodScreenSizes{ 600.f, 300.f, 150.f, 75.f };
+		float m_LodHysteresis{ .1f };
+		std::vector<int> m_MeshLods{};
+
+		// Anisotropic filtering takes up to m_MaxAnisotropy taps per sample. To stay around m_SampleTapBudget taps per frame,
+		// m_FrameAnisotropy is lowered or raised from the previous frame's taps before rasterizing starts
+		int m_MaxAnisotropy{ TextureGradients::MaxAnisotropy };
+		int m_FrameAnisotropy{ TextureGradients::MaxAnisotropy };
+		uint64_t m_SampleTapBudget{ 8'000'000 };
+
+		// Hierarchical rasterization first classifies 64x64 blocks, partial ones are split in 8x8 blocks
+		static constexpr int LargeBlockSize{ 64 };
+		static constexpr int SmallBlockSize{ 8 };
+
+		mutable SoftwareFrameStats m_FrameStats{};
+
+		// Screen is split in TileSize x TileSize tiles, every tile owns its own pixels so tiles can be rasterized in parallel
+		static constexpr int TileSize{ 64 };
+
+		// Triangles are only clipped against the sides once they leave this multiple of the screen
+		static constexpr float GuardBandScale{ 8.f };
+		int m_NrOfTilesX{};
+		int m_NrOfTilesY{};
+
+		// Pipelined frames: the vertex stage of this frame runs on a worker while the previous frame is rasterized,
+		// every mesh has one transformed vertex buffer per snapshot
+		std::array<FrameSnapshot, 2> m_FrameSnapshots{};
+		std::future<void> m_PendingTransform{};
+		int m_NextTransformBuffer{};
+		int m_ReadyBuffer{ -1 }; // transformed but not rasterized yet, -1 if none
+		Vector3 m_ShadingCameraOrigin{};
+
+		// Meshes with at least this many vertices are transformed in chunks on the thread pool,
+		// chunks are a multiple of the vertex stream padding so every chunk starts at a whole SIMD register
+		static constexpr int ParallelTransformThreshold{ 8192 };
+		static constexpr int TransformChunkSize{ 1024 };
+		static_assert(TransformChunkSize % VertexStreams::Padding == 0);
+
+		std::vector<RasterTriangle> m_RasterTriangles{};
+		std::vector<std::vector<uint32_t>> m_TileBins{};
+
+		// Lazy clears: m_FrameNumber of the last frame a tile was cleared for drawing in,
+		// and the color a tile is completely filled with when nothing was drawn in it (0 if unknown, packed pixels always have alpha)
+		uint32_t m_FrameNumber{};
+		uint32_t m_ClearColor{};
+		mutable std::vector<uint32_t> m_TileClearFrames{};
+		mutable std::vector<uint32_t> m_TileFillColors{};
+		// Indices in m_RasterTriangles in the order they are drawn, also the bin of the whole screen when single threaded
+		std::vector<uint32_t> m_DrawOrder{};
+
+		// Transparent triangles sorted back to front: (16 bit quantized depth << 32) | triangle index
+		std::vector<uint64_t> m_SortItems{};
+		std::vector<uint64_t> m_SortScratch{};
+		ThreadPool m_ThreadPool{};
+
 		std::vector<float> m_DepthBuffer{};
-		std::vector<int> m_ClosestTriangle{};
+
+		// Visibility buffer: index in m_RasterTriangles of the closest opaque triangle per pixel, -1 if none
+		mutable std::vector<int> m_ClosestTriangle{};
+
+		// Weighted blended order independent transparency: sum of weighted premultiplied colors (r, g, b, alpha) per pixel
+		// and the product of (1 - alpha), how much of the opaque color still shines through
+		mutable std::array<std::vector<float>, 4> m_TransparentAccumulation{};
+		mutable std::vector<float> m_TransparentRevealage{};
 
 		bool m_IsInitialized{ false };
 
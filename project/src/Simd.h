@@ -0,0 +1,148 @@
+#pragma once
+
+// Thin wrappers around the SSE2 / AVX2 intrinsics used by the software rasterizer.
+// AVX2 is used when the compiler is allowed to (/arch:AVX2 or -mavx2), SSE2 otherwise, which every x64 CPU has.
+// On targets without either, Simd::IsAvailable is false and callers use their scalar path.
+#if defined(__AVX2__)
+#define DAE_SIMD_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define DAE_SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include <cstdint>
+
+namespace dae
+{
+	namespace Simd
+	{
+#if defined(DAE_SIMD_AVX2)
+		constexpr bool IsAvailable{ true };
+		constexpr int Width{ 8 };
+		constexpr const char* Name{ "AVX2" };
+
+		using Float = __m256;
+
+		inline Float Set(float value) { return _mm256_set1_ps(value); }
+		inline Float LaneOffsets() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+		inline Float Load(const float* pData) { return _mm256_loadu_ps(pData); }
+		inline void Store(float* pData, Float value) { _mm256_storeu_ps(pData, value); }
+
+		inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+		inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+		inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+		inline Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+		inline Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+		inline Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+		inline Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+
+		inline Float GreaterThan(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		inline Float LessThan(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		inline Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+		inline Float Or(Float a, Float b) { return _mm256_or_ps(a, b); }
+		inline Float Select(Float mask, Float ifTrue, Float ifFalse) { return _mm256_blendv_ps(ifFalse, ifTrue, mask); }
+
+		// One bit per lane, set if the lane of the mask is set
+		inline int MoveMask(Float mask) { return _mm256_movemask_ps(mask); }
+
+		// 32 bit integer lanes, used to unpack and pack back buffer pixels
+		using Int = __m256i;
+
+		inline Int SetInt(uint32_t value) { return _mm256_set1_epi32(static_cast<int>(value)); }
+		inline Int LoadInt(const uint32_t* pData) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pData)); }
+		inline void StoreInt(uint32_t* pData, Int value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(pData), value); }
+
+		inline Int ShiftLeft(Int a, int count) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(count)); }
+		inline Int ShiftRight(Int a, int count) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(count)); }
+		inline Int AndInt(Int a, Int b) { return _mm256_and_si256(a, b); }
+		inline Int OrInt(Int a, Int b) { return _mm256_or_si256(a, b); }
+
+		inline Float ToFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+		// Rounds towards zero, like static_cast<int>
+		inline Int ToIntTruncate(Float a) { return _mm256_cvttps_epi32(a); }
+
+#elif defined(DAE_SIMD_SSE)
+		constexpr bool IsAvailable{ true };
+		constexpr int Width{ 4 };
+		constexpr const char* Name{ "SSE2" };
+
+		using Float = __m128;
+
+		inline Float Set(float value) { return _mm_set1_ps(value); }
+		inline Float LaneOffsets() { return _mm_setr_ps(0.f, 1.f, 2.f, 3.f); }
+		inline Float Load(const float* pData) { return _mm_loadu_ps(pData); }
+		inline void Store(float* pData, Float value) { _mm_storeu_ps(pData, value); }
+
+		inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+		inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+		inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+		inline Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+		inline Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+		inline Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+		inline Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+
+		inline Float GreaterThan(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+		inline Float LessThan(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+		inline Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+		inline Float Or(Float a, Float b) { return _mm_or_ps(a, b); }
+		// No blendv without SSE4.1, the comparison masks are all ones or all zeros per lane so and/andnot/or does the same
+		inline Float Select(Float mask, Float ifTrue, Float ifFalse) { return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse)); }
+
+		// One bit per lane, set if the lane of the mask is set
+		inline int MoveMask(Float mask) { return _mm_movemask_ps(mask); }
+
+		// 32 bit integer lanes, used to unpack and pack back buffer pixels
+		using Int = __m128i;
+
+		inline Int SetInt(uint32_t value) { return _mm_set1_epi32(static_cast<int>(value)); }
+		inline Int LoadInt(const uint32_t* pData) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData)); }
+		inline void StoreInt(uint32_t* pData, Int value) { _mm_storeu_si128(reinterpret_cast<__m128i*>(pData), value); }
+
+		inline Int ShiftLeft(Int a, int count) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(count)); }
+		inline Int ShiftRight(Int a, int count) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(count)); }
+		inline Int AndInt(Int a, Int b) { return _mm_and_si128(a, b); }
+		inline Int OrInt(Int a, Int b) { return _mm_or_si128(a, b); }
+
+		inline Float ToFloat(Int a) { return _mm_cvtepi32_ps(a); }
+		// Rounds towards zero, like static_cast<int>
+		inline Int ToIntTruncate(Float a) { return _mm_cvttps_epi32(a); }
+
+#else
+		constexpr bool IsAvailable{ false };
+		constexpr int Width{ 1 };
+		constexpr const char* Name{ "Scalar" };
+#endif
+
+		// Blends two packed 8 bit per channel pixels: (source * alpha + destination * (255 - alpha)) / 255, rounded.
+		// x / 255 is computed as (x + 128 + ((x + 128) >> 8)) >> 8, which is exact for x up to 255 * 255
+#if defined(DAE_SIMD_AVX2) || defined(DAE_SIMD_SSE)
+		inline uint32_t BlendPixel(uint32_t source, uint32_t destination, uint32_t alpha)
+		{
+			const __m128i zero = _mm_setzero_si128();
+
+			// One 16 bit lane per channel
+			const __m128i sourceChannels = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(source)), zero);
+			const __m128i destinationChannels = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(destination)), zero);
+
+			__m128i blended = _mm_add_epi16(_mm_mullo_epi16(sourceChannels, _mm_set1_epi16(static_cast<short>(alpha))),
+				_mm_mullo_epi16(destinationChannels, _mm_set1_epi16(static_cast<short>(255 - alpha))));
+			blended = _mm_add_epi16(blended, _mm_set1_epi16(128));
+			blended = _mm_srli_epi16(_mm_add_epi16(blended, _mm_srli_epi16(blended, 8)), 8);
+
+			return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(blended, zero)));
+		}
+#else
+		inline uint32_t BlendPixel(uint32_t source, uint32_t destination, uint32_t alpha)
+		{
+			uint32_t blendedPixel{};
+			for (int shift{ 0 }; shift < 32; shift += 8)
+			{
+				const uint32_t blended = ((source >> shift) & 0xFF) * alpha + ((destination >> shift) & 0xFF) * (255 - alpha) + 128;
+				blendedPixel |= ((blended + (blended >> 8)) >> 8) << shift;
+			}
+			return blendedPixel;
+		}
+#endif
+	}
+}
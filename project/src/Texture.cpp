@@ -1,45 +1,121 @@
 #include "Texture.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <SDL_image.h>
 
+#include "BlockCompression.h"
 #include "Mesh.h"
+#include "Pixel.h"
 #include "Vector2.h"
 #undef min
 
+namespace
+{
+	// 0 is never a texture, so an empty cache entry never matches
+	std::atomic<uint32_t> g_NextTextureId{ 1 };
+
+	// Decoded blocks of the block compressed textures, per rasterizer thread and in the tile's Morton order.
+	// Direct mapped on texture and block, neighbouring pixels mostly read the same few blocks
+	struct DecodedBlock
+	{
+		uint64_t key{};
+		uint32_t texels[dae::BlockCompression::TexelsPerBlock]{};
+	};
+
+	constexpr size_t DecodedBlockCacheSize{ 256 };
+	thread_local std::array<DecodedBlock, DecodedBlockCacheSize> t_DecodedBlocks{};
+}
+
 Texture::~Texture()
 {
- 	m_pResource->Release();
-	m_pSRV->Release();
+	if (m_pSRV) m_pSRV->Release();
+	if (m_pResource) m_pResource->Release();
 }
 
-Texture::Texture()
+void Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path, TextureUsage usage, bool isBlockCompressed)
 {
-	if (m_pSurface)
+	SDL_Surface* pLoadedSurface = IMG_Load(path.c_str());
+	if (!pLoadedSurface)
 	{
-		SDL_FreeSurface(m_pSurface);
-		m_pSurface = nullptr;
+		std::cout << "Failed to load image: " << path << " SDL_Error: " << SDL_GetError() << std::endl;
+		return;
 	}
-}
 
-void Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path)
-{
-	SDL_Surface* surface = IMG_Load(path.c_str());
+	// Decoded once, into RGBA8 unless the image already is. Both rasterizers are fed from this one buffer
+	SDL_Surface* pSurface = pLoadedSurface;
+	if (pLoadedSurface->format->format != dae::TextureFormat)
+	{
+		pSurface = SDL_ConvertSurfaceFormat(pLoadedSurface, dae::TextureFormat, 0);
+		SDL_FreeSurface(pLoadedSurface);
+
+		if (!pSurface)
+		{
+			std::cout << "Failed to convert image: " << path << " SDL_Error: " << SDL_GetError() << std::endl;
+			return;
+		}
+	}
 
-	m_pSurface = surface;
-	m_pSurfacePixels = static_cast<uint32_t*>(surface->pixels);
+	const uint32_t* pTexels = static_cast<const uint32_t*>(pSurface->pixels);
+	const size_t nrOfTexels = static_cast<size_t>(pSurface->w) * pSurface->h;
+	m_Id = g_NextTextureId++;
 
-	SDL_Surface* pSurface = IMG_Load(path.c_str());
-	if (!pSurface)
+	// Blocks are 4x4, D3D only takes block compressed textures whose level 0 is whole blocks
+	if (isBlockCompressed && pSurface->w % dae::BlockCompression::BlockSize == 0 && pSurface->h % dae::BlockCompression::BlockSize == 0)
 	{
-		std::cout << "Failed to load image: " << path << " SDL_Error: " << SDL_GetError() << std::endl;
-		return;
+		switch (usage)
+		{
+		case TextureUsage::Color:
+		{
+			// BC1 is opaque only, BC7 keeps the alpha
+			const bool isOpaque = std::all_of(pTexels, pTexels + nrOfTexels, [](uint32_t texel) { return (texel >> 24) == 0xFF; });
+			m_Encoding = isOpaque ? Encoding::BC1 : Encoding::BC7;
+			break;
+		}
+		case TextureUsage::Normal:
+			m_Encoding = Encoding::BC5;
+			break;
+		case TextureUsage::SingleChannel:
+			m_Encoding = Encoding::BC4;
+			break;
+		}
+	}
+	else
+	{
+		m_Encoding = usage == TextureUsage::SingleChannel ? Encoding::R8 : Encoding::RGBA8;
+	}
+
+	std::vector<uint32_t> rowMajorMipTexels{};
+	BuildMipChain(pTexels, pSurface->w, pSurface->h, rowMajorMipTexels);
+	CreateResource(pDevice, pTexels, rowMajorMipTexels);
+
+	// The tiled mip chain is all the software sampler needs
+	SDL_FreeSurface(pSurface);
+}
+
+void Texture::CreateResource(ID3D11Device* pDevice, const uint32_t* pTexels, const std::vector<uint32_t>& rowMajorMipTexels)
+{
+	// Single channel maps are only ever read through .r in the shaders, normal maps reconstruct z from BC5's x and y
+	DXGI_FORMAT format{};
+	switch (m_Encoding)
+	{
+	case Encoding::RGBA8: format = DXGI_FORMAT_R8G8B8A8_UNORM; break;
+	case Encoding::R8: format = DXGI_FORMAT_R8_UNORM; break;
+	case Encoding::BC1: format = DXGI_FORMAT_BC1_UNORM; break;
+	case Encoding::BC4: format = DXGI_FORMAT_BC4_UNORM; break;
+	case Encoding::BC5: format = DXGI_FORMAT_BC5_UNORM; break;
+	case Encoding::BC7: format = DXGI_FORMAT_BC7_UNORM; break;
 	}
+	const bool isSingleChannel = m_Encoding == Encoding::R8;
+	const UINT bytesPerTexel = isSingleChannel ? 1 : 4;
 
-	DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	D3D11_TEXTURE2D_DESC desc{};
-	desc.Width = pSurface->w;
-	desc.Height = pSurface->h;
-	desc.MipLevels = 1;
+	desc.Width = m_MipLevels[0].width;
+	desc.Height = m_MipLevels[0].height;
+	desc.MipLevels = static_cast<UINT>(m_MipLevels.size());
 	desc.ArraySize = 1;
 	desc.Format = format;
 	desc.SampleDesc.Count = 1;
@@ -49,12 +125,45 @@ void Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path)
 	desc.CPUAccessFlags = 0;
 	desc.MiscFlags = 0;
 
-	D3D11_SUBRESOURCE_DATA initData;
-	initData.pSysMem = pSurface->pixels;
-	initData.SysMemPitch = static_cast<UINT>(pSurface->pitch);
-	initData.SysMemSlicePitch = static_cast<UINT>(pSurface->h * pSurface->pitch);
+	// D3D gets the levels row major, R8 only gets the red bytes.
+	// Blocks already are row by row, so block compressed levels are uploaded straight from the sampler's copy
+	const size_t nrOfLevel0Texels = static_cast<size_t>(m_MipLevels[0].width) * m_MipLevels[0].height;
+	std::vector<uint8_t> singleChannelTexels{};
+	if (isSingleChannel)
+	{
+		singleChannelTexels.resize(nrOfLevel0Texels + rowMajorMipTexels.size());
 
-	HRESULT hr = pDevice->CreateTexture2D(&desc, &initData, &m_pResource);
+		for (size_t texelIdx{ 0 }; texelIdx < singleChannelTexels.size(); ++texelIdx)
+		{
+			const uint32_t texel = texelIdx < nrOfLevel0Texels ? pTexels[texelIdx] : rowMajorMipTexels[texelIdx - nrOfLevel0Texels];
+			singleChannelTexels[texelIdx] = static_cast<uint8_t>(texel & 0xFF);
+		}
+	}
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initData(m_MipLevels.size());
+	size_t levelOffset{};
+	for (size_t levelIdx{ 0 }; levelIdx < m_MipLevels.size(); ++levelIdx)
+	{
+		const MipLevel& level = m_MipLevels[levelIdx];
+		if (IsBlockCompressed())
+		{
+			const size_t blockRows = (static_cast<size_t>(level.height) + dae::BlockCompression::BlockSize - 1) / dae::BlockCompression::BlockSize;
+			initData[levelIdx].pSysMem = level.pTexels;
+			initData[levelIdx].SysMemPitch = static_cast<UINT>(level.tilesPerRow * GetBlockSize());
+			initData[levelIdx].SysMemSlicePitch = static_cast<UINT>(level.tilesPerRow * GetBlockSize() * blockRows);
+			continue;
+		}
+
+		if (isSingleChannel) initData[levelIdx].pSysMem = singleChannelTexels.data() + levelOffset;
+		else if (levelIdx == 0) initData[levelIdx].pSysMem = pTexels;
+		else initData[levelIdx].pSysMem = rowMajorMipTexels.data() + (levelOffset - nrOfLevel0Texels);
+		initData[levelIdx].SysMemPitch = static_cast<UINT>(level.width) * bytesPerTexel;
+		initData[levelIdx].SysMemSlicePitch = static_cast<UINT>(level.width * level.height) * bytesPerTexel;
+
+		levelOffset += static_cast<size_t>(level.width) * level.height;
+	}
+
+	HRESULT hr = pDevice->CreateTexture2D(&desc, initData.data(), &m_pResource);
 
 	if (FAILED(hr))
 	{
@@ -65,7 +174,7 @@ void Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path)
 	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc{};
 	SRVDesc.Format = format;
 	SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	SRVDesc.Texture2D.MipLevels = 1;
+	SRVDesc.Texture2D.MipLevels = desc.MipLevels;
 
 	hr = pDevice->CreateShaderResourceView(m_pResource, &SRVDesc, &m_pSRV);
 	if (FAILED(hr))
@@ -73,8 +182,6 @@ void Texture::LoadFromFile(ID3D11Device* pDevice, const std::string& path)
 		std::cout << "failed to Create Shader Resource View" << std::endl;
 		return ;
 	}
-
-
 }
 
 ID3D11ShaderResourceView* Texture::GetSRV()
@@ -82,112 +189,344 @@ ID3D11ShaderResourceView* Texture::GetSRV()
 	return m_pSRV;
 }
 
+size_t Texture::GetMemorySize() const
+{
+	return m_MipTexels.size() * sizeof(uint32_t);
+}
+
 dae::ColorRGBA Texture::Sample(const dae::Vector2& uv) const
 {
-	float x = uv.x - std::floor(uv.x);
-	float y = uv.y - std::floor(uv.y);
-	x = x * m_pSurface->w;
-	y = y * m_pSurface->h;
+	return SamplePoint(m_MipLevels[0], uv);
+}
+
+dae::ColorRGBA Texture::Sample(const dae::Vector2& uv, const TextureGradients& gradients, const Mesh* currentMesh, uint64_t& nrOfTaps) const
+{
+	const char* technique = currentMesh->GetCurrentTechnique();
 
+	if (std::strcmp(technique, "AnisotropicTechnique") == 0) return SampleAnisotropic(uv, gradients, nrOfTaps);
 
-	uint8_t r, g, b, a;
+	++nrOfTaps;
+	const float mipLevel = ComputeMipLevel(gradients);
 
+	// Like MIN_MAG_MIP_POINT: the closest texel of the closest level
+	if (std::strcmp(technique, "PointTechnique") == 0)
+	{
+		return SamplePoint(m_MipLevels[static_cast<size_t>(mipLevel + .5f)], uv);
+	}
+
+	return SampleTrilinear(uv, mipLevel);
+}
+
+dae::ColorRGBA Texture::SampleAnisotropic(const dae::Vector2& uv, const TextureGradients& gradients, uint64_t& nrOfTaps) const
+{
+	// The footprint's sides in texels of level 0, the longer one is the major axis of the ellipse
+	const float width = static_cast<float>(m_MipLevels[0].width);
+	const float height = static_cast<float>(m_MipLevels[0].height);
 
+	const float lengthX = dae::Vector2{ gradients.uvDerivativeX.x * width, gradients.uvDerivativeX.y * height }.Magnitude();
+	const float lengthY = dae::Vector2{ gradients.uvDerivativeY.x * width, gradients.uvDerivativeY.y * height }.Magnitude();
 
-	//POINT SAMPLING
+	const bool isMajorX = lengthX >= lengthY;
+	const float majorLength = isMajorX ? lengthX : lengthY;
+	const float minorLength = isMajorX ? lengthY : lengthX;
+	const dae::Vector2& majorAxis = isMajorX ? gradients.uvDerivativeX : gradients.uvDerivativeY;
+
+	// Magnified, or not allowed more than one tap
+	const int maxAnisotropy = std::clamp(gradients.maxAnisotropy, 1, TextureGradients::MaxAnisotropy);
+	if (!(majorLength > 1.f) || maxAnisotropy == 1)
 	{
-		Uint8* pPixelAddress = (Uint8*)m_pSurfacePixels + uint32_t(y) * m_pSurface->pitch + uint32_t(x) * m_pSurface->format->BytesPerPixel;
+		++nrOfTaps;
+		return SampleTrilinear(uv, ComputeMipLevel(gradients));
+	}
 
-		SDL_GetRGBA(*(Uint32*)pPixelAddress, m_pSurface->format, &r, &g, &b,&a);
+	// One tap per minor axis length along the major axis, so each tap covers a roughly square part of the footprint.
+	// Capped footprints are blurred a bit along the major axis instead, by sampling a coarser level
+	const int nrOfSamples = minorLength * maxAnisotropy > majorLength
+		? static_cast<int>(std::ceil(majorLength / minorLength)) : maxAnisotropy;
+	const float mipLevel = ClampMipLevel(std::log2(majorLength / static_cast<float>(nrOfSamples)));
 
-		return {
-			r / 255.f ,
-			g / 255.f,
-			b / 255.f,
-			a / 255.f
-		};
+	// Summed by hand, the color operators leave alpha alone
+	dae::ColorRGBA color{ 0.f, 0.f, 0.f, 0.f };
+	for (int sampleIdx{ 0 }; sampleIdx < nrOfSamples; ++sampleIdx)
+	{
+		const float offset = (static_cast<float>(sampleIdx) + .5f) / static_cast<float>(nrOfSamples) - .5f;
+		const dae::ColorRGBA sample = SampleTrilinear(uv + majorAxis * offset, mipLevel);
+		color.r += sample.r;
+		color.g += sample.g;
+		color.b += sample.b;
+		color.a += sample.a;
 	}
 
+	nrOfTaps += static_cast<uint64_t>(nrOfSamples);
+
+	const float weight = 1.f / static_cast<float>(nrOfSamples);
+	return { color.r * weight, color.g * weight, color.b * weight, color.a * weight };
 }
 
-dae::ColorRGBA Texture::Sample(const dae::Vector2& uv, const Mesh* currentMesh) const
+size_t Texture::GetTiledSize(int width, int height)
 {
-	float x = uv.x - std::floor(uv.x);
-	float y = uv.y - std::floor(uv.y);
-	x = x * m_pSurface->w;
-	y = y * m_pSurface->h;
+	// Partial tiles on the right and bottom edge are padded to whole ones
+	const size_t tilesPerRow = static_cast<size_t>((width + TileSize - 1) / TileSize);
+	const size_t tilesPerColumn = static_cast<size_t>((height + TileSize - 1) / TileSize);
 
+	return tilesPerRow * tilesPerColumn * (TileSize * TileSize);
+}
 
-	uint8_t r, g, b, a;
+size_t Texture::GetLevelSize(int width, int height) const
+{
+	// One block per tile, including the padded ones
+	const size_t nrOfTiledTexels = GetTiledSize(width, height);
+	if (IsBlockCompressed()) return nrOfTiledTexels / dae::BlockCompression::TexelsPerBlock * GetBlockSize();
+
+	return nrOfTiledTexels * (m_Encoding == Encoding::R8 ? 1 : 4);
+}
+
+bool Texture::IsBlockCompressed() const
+{
+	return m_Encoding != Encoding::RGBA8 && m_Encoding != Encoding::R8;
+}
 
-	Uint8* pPixelAddress = (Uint8*)m_pSurfacePixels + uint32_t(y) * m_pSurface->pitch + uint32_t(x) * m_pSurface->format->BytesPerPixel;
+size_t Texture::GetBlockSize() const
+{
+	return m_Encoding == Encoding::BC1 || m_Encoding == Encoding::BC4 ? 8 : 16;
+}
 
-	if (currentMesh->GetCurrentTechnique() == "LinearTechnique")
+void Texture::BuildMipChain(const uint32_t* pTexels, int width, int height, std::vector<uint32_t>& rowMajorTexels)
+{
+	// Sizes first, so neither vector reallocates while the levels point into it
+	std::vector<MipLevel> rowMajorLevels{ { width, height, 0, pTexels } };
+	size_t nrOfRowMajorTexels{};
+	size_t nrOfTiledBytes{ GetLevelSize(width, height) };
+	for (int levelWidth{ width }, levelHeight{ height }; levelWidth > 1 || levelHeight > 1;)
 	{
-		//Linear Sampling
-		float x1 = x - 0.5f;
-		float x2 = x + 0.5f;
-		float y1 = y - 0.5f;
-		float y2 = y + 0.5f;
+		levelWidth = std::max(levelWidth / 2, 1);
+		levelHeight = std::max(levelHeight / 2, 1);
+		nrOfRowMajorTexels += static_cast<size_t>(levelWidth) * levelHeight;
+		nrOfTiledBytes += GetLevelSize(levelWidth, levelHeight);
+	}
+	rowMajorTexels.assign(nrOfRowMajorTexels, 0);
+	// Tiles are at least 16 texels and blocks 8 bytes, so every level still starts on a whole uint32_t
+	m_MipTexels.assign(nrOfTiledBytes / sizeof(uint32_t), 0);
 
-		// Find the nearest integer pixel positions
-		int xPxl = std::floor(x);
-		int yPxl = std::floor(y);
+	// 2x2 box filter per channel, an odd last row or column is reused instead of read past
+	uint32_t* pLevelTexels = rowMajorTexels.data();
+	while (rowMajorLevels.back().width > 1 || rowMajorLevels.back().height > 1)
+	{
+		const MipLevel source = rowMajorLevels.back();
+		const MipLevel level{ std::max(source.width / 2, 1), std::max(source.height / 2, 1), 0, pLevelTexels };
+
+		for (int y{ 0 }; y < level.height; ++y)
+		{
+			const uint32_t* pRow0 = source.pTexels + static_cast<size_t>(2 * y) * source.width;
+			const uint32_t* pRow1 = source.pTexels + static_cast<size_t>(std::min(2 * y + 1, source.height - 1)) * source.width;
+
+			for (int x{ 0 }; x < level.width; ++x)
+			{
+				const int x0 = 2 * x;
+				const int x1 = std::min(2 * x + 1, source.width - 1);
+
+				uint32_t texel{};
+				for (int shift{ 0 }; shift < 32; shift += 8)
+				{
+					const uint32_t sum = ((pRow0[x0] >> shift) & 0xFF) + ((pRow0[x1] >> shift) & 0xFF)
+						+ ((pRow1[x0] >> shift) & 0xFF) + ((pRow1[x1] >> shift) & 0xFF);
+					texel |= ((sum + 2) >> 2) << shift;
+				}
+				pLevelTexels[static_cast<size_t>(y) * level.width + x] = texel;
+			}
+		}
+
+		pLevelTexels += static_cast<size_t>(level.width) * level.height;
+		rowMajorLevels.push_back(level);
+	}
 
-		if (x - xPxl > 0.5f) xPxl += 1; // Adjust x if in the right quadrant
-		if (y - yPxl > 0.5f) yPxl += 1; // Adjust y if in the bottom quadrant
+	// The software sampler reads the tiled copy
+	m_MipLevels.clear();
+	uint32_t* pTiledTexels = m_MipTexels.data();
+	std::vector<uint8_t> singleChannelTexels{};
+	for (const MipLevel& rowMajorLevel : rowMajorLevels)
+	{
+		const size_t nrOfTexels = static_cast<size_t>(rowMajorLevel.width) * rowMajorLevel.height;
+
+		if (IsBlockCompressed())
+		{
+			EncodeBlocks(rowMajorLevel.pTexels, rowMajorLevel.width, rowMajorLevel.height, reinterpret_cast<uint8_t*>(pTiledTexels));
+		}
+		else if (m_Encoding == Encoding::R8)
+		{
+			singleChannelTexels.resize(nrOfTexels);
+			for (size_t texelIdx{ 0 }; texelIdx < nrOfTexels; ++texelIdx)
+			{
+				singleChannelTexels[texelIdx] = static_cast<uint8_t>(rowMajorLevel.pTexels[texelIdx] & 0xFF);
+			}
+			TileTexels(singleChannelTexels.data(), rowMajorLevel.width, rowMajorLevel.height, reinterpret_cast<uint8_t*>(pTiledTexels));
+		}
+		else
+		{
+			TileTexels(rowMajorLevel.pTexels, rowMajorLevel.width, rowMajorLevel.height, pTiledTexels);
+		}
+
+		m_MipLevels.push_back({ rowMajorLevel.width, rowMajorLevel.height, (rowMajorLevel.width + TileSize - 1) / TileSize, pTiledTexels });
+		pTiledTexels += GetLevelSize(rowMajorLevel.width, rowMajorLevel.height) / sizeof(uint32_t);
+	}
+}
 
-		// Calculate addresses for the 4 surrounding texels
-		Uint8* topLeftPixel = (Uint8*)m_pSurfacePixels + uint32_t(y1) * m_pSurface->pitch + uint32_t(x1) * m_pSurface->format->BytesPerPixel;
-		Uint8* topRightPixel = (Uint8*)m_pSurfacePixels + uint32_t(y1) * m_pSurface->pitch + uint32_t(x2) * m_pSurface->format->BytesPerPixel;
-		Uint8* bottomLeftPixel = (Uint8*)m_pSurfacePixels + uint32_t(y2) * m_pSurface->pitch + uint32_t(x1) * m_pSurface->format->BytesPerPixel;
-		Uint8* bottomRightPixel = (Uint8*)m_pSurfacePixels + uint32_t(y2) * m_pSurface->pitch + uint32_t(x2) * m_pSurface->format->BytesPerPixel;
+float Texture::ComputeMipLevel(const TextureGradients& gradients) const
+{
+	// Longest side of the pixel's footprint, in texels of level 0
+	const float width = static_cast<float>(m_MipLevels[0].width);
+	const float height = static_cast<float>(m_MipLevels[0].height);
 
-		dae::ColorRGBA finalColor{};	
-		uint8_t r, g, b, a;
+	const dae::Vector2 footprintX{ gradients.uvDerivativeX.x * width, gradients.uvDerivativeX.y * height };
+	const dae::Vector2 footprintY{ gradients.uvDerivativeY.x * width, gradients.uvDerivativeY.y * height };
+	const float footprintSquared = std::max(footprintX.SqrMagnitude(), footprintY.SqrMagnitude());
 
-		// Top-left
-		SDL_GetRGBA(*(Uint32*)topLeftPixel, m_pSurface->format, &r, &g, &b, &a);
-		finalColor += dae::ColorRGBA(r, g, b, a) * ((xPxl - x1) * (yPxl - y1));
+	// log2 of the length, without the square root
+	return ClampMipLevel(.5f * std::log2(footprintSquared));
+}
 
-		// Top-right
-		SDL_GetRGBA(*(Uint32*)topRightPixel, m_pSurface->format, &r, &g, &b, &a);
-		finalColor += dae::ColorRGBA(r, g, b, a) * ((x2 - xPxl) * (yPxl - y1));
+float Texture::ClampMipLevel(float mipLevel) const
+{
+	// No gradients (or NaN) is magnification, level 0
+	if (!(mipLevel > 0.f)) return 0.f;
+
+	return std::min(mipLevel, static_cast<float>(m_MipLevels.size() - 1));
+}
 
-		// Bottom-left
-		SDL_GetRGBA(*(Uint32*)bottomLeftPixel, m_pSurface->format, &r, &g, &b, &a);
-		finalColor += dae::ColorRGBA(r, g, b, a) * ((xPxl - x1) * (y2 - yPxl));
+dae::ColorRGBA Texture::SampleTrilinear(const dae::Vector2& uv, float mipLevel) const
+{
+	// Bilinear in the two closest levels, blended by how far the footprint is between them
+	const size_t lowerLevel = static_cast<size_t>(mipLevel);
+	const float levelWeight = mipLevel - static_cast<float>(lowerLevel);
 
-		// Bottom-right
-		SDL_GetRGBA(*(Uint32*)bottomRightPixel, m_pSurface->format, &r, &g, &b, &a);
-		finalColor += dae::ColorRGBA(r, g, b, a) * ((x2 - xPxl) * (y2 - yPxl));
+	const dae::ColorRGBA lowerColor = SampleBilinear(m_MipLevels[lowerLevel], uv);
+	if (levelWeight <= 0.f) return lowerColor;
 
-		SDL_GetRGBA(*(Uint32*)pPixelAddress, m_pSurface->format, &r, &g, &b, &a);
-	
-		finalColor.a = a / 255.f;
+	return dae::ColorRGBA::Lerp(lowerColor, SampleBilinear(m_MipLevels[lowerLevel + 1], uv), levelWeight);
+}
 
-		return finalColor / 255.f;
+void Texture::EncodeBlocks(const uint32_t* pTexels, int width, int height, uint8_t* pBlocks) const
+{
+	using namespace dae::BlockCompression;
+
+	const int blocksPerRow = (width + BlockSize - 1) / BlockSize;
+	const int blocksPerColumn = (height + BlockSize - 1) / BlockSize;
+
+	for (int blockY{ 0 }; blockY < blocksPerColumn; ++blockY)
+	{
+		for (int blockX{ 0 }; blockX < blocksPerRow; ++blockX)
+		{
+			// Levels smaller than a block repeat their last row and column
+			uint32_t blockTexels[TexelsPerBlock];
+			for (int y{ 0 }; y < BlockSize; ++y)
+			{
+				for (int x{ 0 }; x < BlockSize; ++x)
+				{
+					const int texelX = std::min(blockX * BlockSize + x, width - 1);
+					const int texelY = std::min(blockY * BlockSize + y, height - 1);
+					blockTexels[y * BlockSize + x] = pTexels[static_cast<size_t>(texelY) * width + texelX];
+				}
+			}
+
+			uint8_t* pBlock = pBlocks + (static_cast<size_t>(blockY) * blocksPerRow + blockX) * GetBlockSize();
+			switch (m_Encoding)
+			{
+			case Encoding::BC1: EncodeBC1(blockTexels, pBlock); break;
+			case Encoding::BC4: EncodeBC4(blockTexels, pBlock); break;
+			case Encoding::BC5: EncodeBC5(blockTexels, pBlock); break;
+			case Encoding::BC7: EncodeBC7(blockTexels, pBlock); break;
+			default: break;
+			}
+		}
 	}
+}
 
-	if (currentMesh->GetCurrentTechnique() == "AnisotropicTechnique")
+dae::ColorRGBA Texture::FetchTexel(const MipLevel& level, size_t texelIdx) const
+{
+	switch (m_Encoding)
 	{
+	case Encoding::RGBA8: return dae::UnpackTexel(level.pTexels[texelIdx]);
+	case Encoding::R8: return dae::UnpackSingleChannelTexel(reinterpret_cast<const uint8_t*>(level.pTexels)[texelIdx]);
+	default: return dae::UnpackTexel(FetchCompressedTexel(level, texelIdx));
 	}
+}
 
-	
+uint32_t Texture::FetchCompressedTexel(const MipLevel& level, size_t texelIdx) const
+{
+	using namespace dae::BlockCompression;
 
-	SDL_GetRGBA(*(Uint32*)pPixelAddress, m_pSurface->format, &r, &g, &b, &a);
+	// A tile is one block, so the tiled index is the block and the texel's Morton index inside it
+	const uint8_t* pBlock = reinterpret_cast<const uint8_t*>(level.pTexels) + texelIdx / TexelsPerBlock * GetBlockSize();
+	const size_t blockOffset = static_cast<size_t>(pBlock - reinterpret_cast<const uint8_t*>(m_MipTexels.data()));
+	const uint64_t key = (static_cast<uint64_t>(m_Id) << 32) | blockOffset;
 
-	return {
-		r / 255.f ,
-		g / 255.f,
-		b / 255.f,
-		a / 255.f
-	};
+	DecodedBlock& decodedBlock = t_DecodedBlocks[(key * 0x9E3779B97F4A7C15ull) >> 56];
+	if (decodedBlock.key != key)
+	{
+		uint32_t blockTexels[TexelsPerBlock];
+		switch (m_Encoding)
+		{
+		case Encoding::BC1: DecodeBC1(pBlock, blockTexels); break;
+		case Encoding::BC4: DecodeBC4(pBlock, blockTexels); break;
+		case Encoding::BC5: DecodeBC5(pBlock, blockTexels); break;
+		case Encoding::BC7: DecodeBC7(pBlock, blockTexels); break;
+		default: break;
+		}
+
+		// Decoders give the texels row by row
+		for (int y{ 0 }; y < BlockSize; ++y)
+		{
+			for (int x{ 0 }; x < BlockSize; ++x)
+			{
+				decodedBlock.texels[GetTiledIndex(x, y, 1)] = blockTexels[y * BlockSize + x];
+			}
+		}
+		decodedBlock.key = key;
+	}
+
+	return decodedBlock.texels[texelIdx % TexelsPerBlock];
+}
+
+dae::ColorRGBA Texture::SamplePoint(const MipLevel& level, const dae::Vector2& uv) const
+{
+	const float u = uv.x - std::floor(uv.x);
+	const float v = uv.y - std::floor(uv.y);
+
+	// u * width can round up to width for u just below 1
+	const int x = std::min(static_cast<int>(u * level.width), level.width - 1);
+	const int y = std::min(static_cast<int>(v * level.height), level.height - 1);
 
+	return FetchTexel(level, GetTiledIndex(x, y, level.tilesPerRow));
 }
 
-Texture::Texture(SDL_Surface* pSurface) :
-	m_pSurface{ pSurface },
-	m_pSurfacePixels{ static_cast<uint32_t*>(pSurface->pixels) }
+dae::ColorRGBA Texture::SampleBilinear(const MipLevel& level, const dae::Vector2& uv) const
 {
+	// Texel centers are at .5, the four texels around the sample point wrap around the edges
+	const float x = (uv.x - std::floor(uv.x)) * level.width - .5f;
+	const float y = (uv.y - std::floor(uv.y)) * level.height - .5f;
+
+	const float floorX = std::floor(x);
+	const float floorY = std::floor(y);
+	const float weightX = x - floorX;
+	const float weightY = y - floorY;
+
+	int x0 = static_cast<int>(floorX);
+	int y0 = static_cast<int>(floorY);
+	int x1 = x0 + 1;
+	int y1 = y0 + 1;
+	if (x0 < 0) x0 = level.width - 1;
+	if (y0 < 0) y0 = level.height - 1;
+	if (x1 >= level.width) x1 = 0;
+	if (y1 >= level.height) y1 = 0;
+
+	const size_t row0 = GetTiledOffsetY(y0, level.tilesPerRow);
+	const size_t row1 = GetTiledOffsetY(y1, level.tilesPerRow);
+	const size_t offsetX0 = GetTiledOffsetX(x0);
+	const size_t offsetX1 = GetTiledOffsetX(x1);
+
+	// Lerp instead of the color operators, those leave alpha alone
+	const dae::ColorRGBA top = dae::ColorRGBA::Lerp(FetchTexel(level, row0 + offsetX0), FetchTexel(level, row0 + offsetX1), weightX);
+	const dae::ColorRGBA bottom = dae::ColorRGBA::Lerp(FetchTexel(level, row1 + offsetX0), FetchTexel(level, row1 + offsetX1), weightX);
+
+	return dae::ColorRGBA::Lerp(top, bottom, weightY);
 }
@@ -1,34 +1,142 @@
 #pragma once
 #include <d3d11.h>
 #include <string>
+#include <vector>
 
 #include "ColorRGBA.h"
-#include "SDL_surface.h"
+#include "Vector2.h"
 
 
 class Mesh;
 
-namespace dae
+// What the texels hold, picks the block compressed format a texture is stored in
+enum class TextureUsage
 {
-	struct Vector2;
-}
+	// BC1, or BC7 when the image has transparent texels
+	Color,
+	// BC5, only x and y are stored. The z of the unit normal is reconstructed when sampling
+	Normal,
+	// BC4, maps that are only ever read through their red channel (gloss, specular)
+	SingleChannel
+};
+
+// How much the UV changes to the next pixel on the right and the next pixel below, picks the mip level to sample
+struct TextureGradients
+{
+	static constexpr int MaxAnisotropy{ 16 };
+
+	dae::Vector2 uvDerivativeX{};
+	dae::Vector2 uvDerivativeY{};
+	// Most taps an anisotropic sample may take, 1 is plain trilinear
+	int maxAnisotropy{ 1 };
+};
 
 class Texture
 {
 public:
 	~Texture();
-	Texture();
-	void LoadFromFile(ID3D11Device* pDevice, const std::string& path);
+	Texture() = default;
+	// Single channel textures only keep the red channel, sampling returns it in r, g and b.
+	// Block compressed textures are encoded once here, D3D gets the blocks and the software sampler decodes them when read.
+	// Images whose sides aren't a multiple of 4 are never block compressed
+	void LoadFromFile(ID3D11Device* pDevice, const std::string& path, TextureUsage usage = TextureUsage::Color, bool isBlockCompressed = true);
 	ID3D11ShaderResourceView* GetSRV();
+	// Bytes the software sampler's copy of the mip chain takes
+	size_t GetMemorySize() const;
 	dae::ColorRGBA Sample(const dae::Vector2& uv) const;
-	dae::ColorRGBA Sample(const dae::Vector2& uv, const Mesh* currentMesh) const;
+	// nrOfTaps is increased by the number of trilinear (or point) lookups the sample took
+	dae::ColorRGBA Sample(const dae::Vector2& uv, const TextureGradients& gradients, const Mesh* currentMesh, uint64_t& nrOfTaps) const;
+	dae::ColorRGBA SampleAnisotropic(const dae::Vector2& uv, const TextureGradients& gradients, uint64_t& nrOfTaps) const;
+
+	// The sampled copy of the texels is stored in TileSize x TileSize tiles of one 64 byte cache line,
+	// so a bilinear footprint mostly stays in one line whichever way the texture is walked.
+	// Tiles are stored row by row, the texels inside a tile in Morton (Z) order
+	static constexpr int TileSize{ 4 };
+	static size_t GetTiledIndex(int x, int y, int tilesPerRow);
+	// The index is the sum of a part that only depends on x and one that only depends on y,
+	// so a bilinear footprint needs two of each instead of four full indices
+	static size_t GetTiledOffsetX(int x);
+	static size_t GetTiledOffsetY(int y, int tilesPerRow);
+	static size_t GetTiledSize(int width, int height);
+	template<typename TexelType>
+	static void TileTexels(const TexelType* pRowMajorTexels, int width, int height, TexelType* pTiledTexels);
 private:
-	Texture(SDL_Surface* pSurface);
+	enum class Encoding
+	{
+		RGBA8,
+		R8,
+		BC1,
+		BC4,
+		BC5,
+		BC7
+	};
+
+	// Level 0 is the image, every next level halves both sides down to 1x1
+	struct MipLevel
+	{
+		int width{};
+		int height{};
+		// Blocks per row in block compressed textures, a block covers one tile
+		int tilesPerRow{};
+		// One byte per texel in single channel textures, the blocks (row by row) in block compressed textures
+		const uint32_t* pTexels{ nullptr };
+	};
+
+	// rowMajorTexels gets levels 1 and up, one after the other, for the D3D texture
+	void BuildMipChain(const uint32_t* pTexels, int width, int height, std::vector<uint32_t>& rowMajorTexels);
+	void CreateResource(ID3D11Device* pDevice, const uint32_t* pTexels, const std::vector<uint32_t>& rowMajorMipTexels);
+	size_t GetLevelSize(int width, int height) const;
+	bool IsBlockCompressed() const;
+	size_t GetBlockSize() const;
+	// pBlocks gets the level's blocks row by row, the last row and column of blocks padded with the edge texels
+	void EncodeBlocks(const uint32_t* pTexels, int width, int height, uint8_t* pBlocks) const;
+	dae::ColorRGBA FetchTexel(const MipLevel& level, size_t texelIdx) const;
+	uint32_t FetchCompressedTexel(const MipLevel& level, size_t texelIdx) const;
+	float ComputeMipLevel(const TextureGradients& gradients) const;
+	float ClampMipLevel(float mipLevel) const;
+	dae::ColorRGBA SampleTrilinear(const dae::Vector2& uv, float mipLevel) const;
+	dae::ColorRGBA SamplePoint(const MipLevel& level, const dae::Vector2& uv) const;
+	dae::ColorRGBA SampleBilinear(const MipLevel& level, const dae::Vector2& uv) const;
 
 	ID3D11Texture2D* m_pResource{};
 	ID3D11ShaderResourceView* m_pSRV{};
 
-	SDL_Surface* m_pSurface{ nullptr };
-	uint32_t* m_pSurfacePixels{ nullptr };
+	Encoding m_Encoding{ Encoding::RGBA8 };
+	// Unique per texture, tags its blocks in the decoded block cache
+	uint32_t m_Id{};
+	std::vector<MipLevel> m_MipLevels{};
+	// Tiled texels (or blocks) of every level, one after the other. This is the only copy the texture keeps
+	std::vector<uint32_t> m_MipTexels{};
 };
 
+inline size_t Texture::GetTiledIndex(int x, int y, int tilesPerRow)
+{
+	return GetTiledOffsetX(x) + GetTiledOffsetY(y, tilesPerRow);
+}
+
+// Inside a tile the 2 low bits of x and y are interleaved as x0 y0 x1 y1
+inline size_t Texture::GetTiledOffsetX(int x)
+{
+	const size_t tileX = static_cast<size_t>(x) / TileSize;
+	return tileX * (TileSize * TileSize) + ((x & 1) | ((x & 2) << 1));
+}
+
+inline size_t Texture::GetTiledOffsetY(int y, int tilesPerRow)
+{
+	const size_t tileY = static_cast<size_t>(y) / TileSize;
+	return tileY * tilesPerRow * (TileSize * TileSize) + (((y & 1) << 1) | ((y & 2) << 2));
+}
+
+template<typename TexelType>
+void Texture::TileTexels(const TexelType* pRowMajorTexels, int width, int height, TexelType* pTiledTexels)
+{
+	const int tilesPerRow = (width + TileSize - 1) / TileSize;
+
+	for (int y{ 0 }; y < height; ++y)
+	{
+		for (int x{ 0 }; x < width; ++x)
+		{
+			pTiledTexels[GetTiledIndex(x, y, tilesPerRow)] = pRowMajorTexels[static_cast<size_t>(y) * width + x];
+		}
+	}
+}
@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+
+namespace dae
+{
+	ThreadPool::ThreadPool(unsigned int nrOfThreads)
+	{
+		// The calling thread also takes jobs, so it counts as one of the threads
+		if (nrOfThreads == 0) nrOfThreads = 1;
+
+		for (unsigned int idx{ 1 }; idx < nrOfThreads; idx++)
+		{
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WakeCondition.notify_all();
+
+		for (auto& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(int nrOfJobs, const std::function<void(int)>& job)
+	{
+		if (nrOfJobs <= 0) return;
+
+		if (m_Workers.empty() || nrOfJobs == 1)
+		{
+			for (int idx{}; idx < nrOfJobs; idx++) job(idx);
+			return;
+		}
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_pJob = &job;
+			m_NrOfJobs = nrOfJobs;
+			m_NextJob = 0;
+			m_NrOfBusyWorkers = static_cast<int>(m_Workers.size());
+			++m_Generation;
+		}
+		m_WakeCondition.notify_all();
+
+		RunJobs();
+
+		std::unique_lock lock{ m_Mutex };
+		m_DoneCondition.wait(lock, [this] { return m_NrOfBusyWorkers == 0; });
+		m_pJob = nullptr;
+	}
+
+	unsigned int ThreadPool::GetNrOfThreads() const
+	{
+		return static_cast<unsigned int>(m_Workers.size()) + 1;
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		uint64_t lastGeneration{};
+
+		while (true)
+		{
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WakeCondition.wait(lock, [&] { return m_IsStopping || m_Generation != lastGeneration; });
+
+				if (m_IsStopping) return;
+
+				lastGeneration = m_Generation;
+			}
+
+			RunJobs();
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				--m_NrOfBusyWorkers;
+			}
+			m_DoneCondition.notify_one();
+		}
+	}
+
+	void ThreadPool::RunJobs()
+	{
+		// Jobs are handed out one at a time so uneven jobs (e.g. busy tiles) balance themselves out
+		for (int idx{ m_NextJob++ }; idx < m_NrOfJobs; idx = m_NextJob++)
+		{
+			(*m_pJob)(idx);
+		}
+	}
+}
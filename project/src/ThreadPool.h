@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	class ThreadPool final
+	{
+	public:
+		ThreadPool(unsigned int nrOfThreads = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		// Runs job(0) ... job(nrOfJobs - 1) on the workers and the calling thread, returns once all jobs are done
+		void ParallelFor(int nrOfJobs, const std::function<void(int)>& job);
+		unsigned int GetNrOfThreads() const;
+
+	private:
+		void WorkerLoop();
+		void RunJobs();
+
+		std::vector<std::thread> m_Workers{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+
+		const std::function<void(int)>* m_pJob{ nullptr };
+		int m_NrOfJobs{};
+		std::atomic<int> m_NextJob{};
+		int m_NrOfBusyWorkers{};
+		uint64_t m_Generation{};
+
+		bool m_IsStopping{ false };
+	};
+}
@@ -1,5 +1,9 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <fstream>
+#include <unordered_map>
 #include <vector>
 #include "Math.h"
 #include "Mesh.h"
@@ -8,10 +12,363 @@ namespace dae
 {
 	namespace Utils
 	{
-		//Just parses vertices and indices
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding = true)
+		//Merges vertices with the exact same position, UV and normal, rewrites the indices and drops zero area triangles
+		static void WeldVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			// Compared bit for bit, so the hash and the equality test always agree
+			using VertexKey = std::array<uint32_t, 8>;
+			struct VertexKeyHash
+			{
+				size_t operator()(const VertexKey& key) const
+				{
+					// FNV-1a over the 8 values
+					uint64_t hash{ 14695981039346656037ull };
+					for (const uint32_t value : key)
+					{
+						hash = (hash ^ value) * 1099511628211ull;
+					}
+					return static_cast<size_t>(hash);
+				}
+			};
+
+			std::unordered_map<VertexKey, uint32_t, VertexKeyHash> weldedIndices{};
+			weldedIndices.reserve(vertices.size());
+
+			std::vector<Vertex> weldedVertices{};
+			std::vector<uint32_t> remappedIndices(vertices.size());
+
+			for (size_t idx = 0; idx < vertices.size(); idx++)
+			{
+				const Vertex& vertex = vertices[idx];
+				const VertexKey key{
+					std::bit_cast<uint32_t>(vertex.Position.x), std::bit_cast<uint32_t>(vertex.Position.y), std::bit_cast<uint32_t>(vertex.Position.z),
+					std::bit_cast<uint32_t>(vertex.UV.x), std::bit_cast<uint32_t>(vertex.UV.y),
+					std::bit_cast<uint32_t>(vertex.Normal.x), std::bit_cast<uint32_t>(vertex.Normal.y), std::bit_cast<uint32_t>(vertex.Normal.z) };
+
+				const auto [it, isNewVertex] = weldedIndices.try_emplace(key, uint32_t(weldedVertices.size()));
+				if (isNewVertex) weldedVertices.push_back(vertex);
+
+				remappedIndices[idx] = it->second;
+			}
+
+			std::vector<uint32_t> weldedTriangles{};
+			weldedTriangles.reserve(indices.size());
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				const uint32_t index0 = remappedIndices[indices[i]];
+				const uint32_t index1 = remappedIndices[indices[i + 1]];
+				const uint32_t index2 = remappedIndices[indices[i + 2]];
+
+				if (index0 == index1 || index1 == index2 || index2 == index0) continue;
+
+				const Vector3& p0 = weldedVertices[index0].Position;
+				const Vector3 normal = Vector3::Cross(weldedVertices[index1].Position - p0, weldedVertices[index2].Position - p0);
+				if (normal.SqrMagnitude() == 0.f) continue;
+
+				weldedTriangles.push_back(index0);
+				weldedTriangles.push_back(index1);
+				weldedTriangles.push_back(index2);
+			}
+
+			vertices = std::move(weldedVertices);
+			indices = std::move(weldedTriangles);
+		}
+
+		//Quadric error metric simplification down to about targetIndexCount indices, by half edge collapses:
+		//a vertex only ever moves onto a neighbour, so the simplified triangles still index the same vertex buffer.
+		//Collapses work on positions, so all vertices welding kept apart for their UV or normal move together,
+		//each onto the neighbour on its own side of the seam. If one of them has none, the seam would tear and the collapse is skipped
+		static void SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount,
+			std::vector<uint32_t>& simplifiedIndices)
+		{
+			// Sum of squared distances to a set of planes, symmetric 4x4 matrix stored as its upper triangle
+			struct Quadric
+			{
+				std::array<double, 10> m{};
+
+				void AddPlane(const Vector3& normal, float distance)
+				{
+					const double plane[4]{ normal.x, normal.y, normal.z, distance };
+					int idx{ 0 };
+					for (int row{ 0 }; row < 4; row++)
+					for (int column{ row }; column < 4; column++)
+					{
+						m[idx++] += plane[row] * plane[column];
+					}
+				}
+
+				void Add(const Quadric& other)
+				{
+					for (int idx{ 0 }; idx < 10; idx++) m[idx] += other.m[idx];
+				}
+
+				double Evaluate(const Vector3& p) const
+				{
+					const double point[4]{ p.x, p.y, p.z, 1.0 };
+					double error{ 0.0 };
+					int idx{ 0 };
+					for (int row{ 0 }; row < 4; row++)
+					for (int column{ row }; column < 4; column++)
+					{
+						error += m[idx++] * point[row] * point[column] * (row == column ? 1.0 : 2.0);
+					}
+					return error;
+				}
+			};
+
+			// Position id per vertex, and the vertices (wedges) of every position
+			std::vector<uint32_t> positionIds(vertices.size());
+			std::vector<std::vector<uint32_t>> positionWedges{};
+			{
+				// Compared bit for bit, like WeldVertices
+				using PositionKey = std::array<uint32_t, 3>;
+				struct PositionKeyHash
+				{
+					size_t operator()(const PositionKey& key) const
+					{
+						uint64_t hash{ 14695981039346656037ull };
+						for (const uint32_t value : key)
+						{
+							hash = (hash ^ value) * 1099511628211ull;
+						}
+						return static_cast<size_t>(hash);
+					}
+				};
+
+				std::unordered_map<PositionKey, uint32_t, PositionKeyHash> positionIdsByKey{};
+				positionIdsByKey.reserve(vertices.size());
+
+				for (uint32_t vertexIdx = 0; vertexIdx < vertices.size(); vertexIdx++)
+				{
+					const Vector3& position = vertices[vertexIdx].Position;
+					const PositionKey key{ std::bit_cast<uint32_t>(position.x), std::bit_cast<uint32_t>(position.y), std::bit_cast<uint32_t>(position.z) };
+
+					const auto [it, isNewPosition] = positionIdsByKey.try_emplace(key, uint32_t(positionWedges.size()));
+					if (isNewPosition) positionWedges.emplace_back();
+
+					positionIds[vertexIdx] = it->second;
+					positionWedges[it->second].push_back(vertexIdx);
+				}
+			}
+
+			const size_t nrOfPositions = positionWedges.size();
+			const auto edgeKey = [](uint32_t start, uint32_t end) { return (uint64_t(std::min(start, end)) << 32) | std::max(start, end); };
+
+			// How many triangles use every edge between two positions: 1 on the border of an open surface, 2 inside
+			std::unordered_map<uint64_t, int> edgeUseCounts{};
+			const auto countEdges = [&](const std::vector<uint32_t>& triangles)
+			{
+				edgeUseCounts.clear();
+				for (size_t i = 0; i < triangles.size(); i++)
+				{
+					edgeUseCounts[edgeKey(positionIds[triangles[i]], positionIds[triangles[i - i % 3 + (i + 1) % 3]])]++;
+				}
+			};
+
+			std::vector<Quadric> quadrics(nrOfPositions);
+			countEdges(indices);
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				const Vector3& p0 = vertices[indices[i]].Position;
+				const Vector3 normal = Vector3::Cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0).Normalized();
+
+				for (int corner{ 0 }; corner < 3; corner++)
+				{
+					const uint32_t start = indices[i + corner];
+					const uint32_t end = indices[i + (corner + 1) % 3];
+					quadrics[positionIds[start]].AddPlane(normal, -Vector3::Dot(normal, p0));
+
+					// Border edges also get the plane through them, perpendicular to the triangle, so the outline only shrinks at a cost
+					if (edgeUseCounts[edgeKey(positionIds[start], positionIds[end])] != 1) continue;
+
+					const Vector3 borderNormal = Vector3::Cross(vertices[end].Position - vertices[start].Position, normal).Normalized();
+					const float borderDistance = -Vector3::Dot(borderNormal, vertices[start].Position);
+					quadrics[positionIds[start]].AddPlane(borderNormal, borderDistance);
+					quadrics[positionIds[end]].AddPlane(borderNormal, borderDistance);
+				}
+			}
+
+			simplifiedIndices = indices;
+
+			struct Collapse
+			{
+				double error;
+				uint32_t from;
+				uint32_t to;
+			};
+			std::vector<Collapse> collapses{};
+			std::vector<uint32_t> triangleOffsets(vertices.size() + 1);
+			std::vector<uint32_t> vertexTriangles{};
+			std::vector<uint32_t> insertPositions{};
+			std::vector<bool> isTouched(nrOfPositions);
+			std::vector<int> nrOfBorderEdges(nrOfPositions);
+			std::vector<bool> isLocked(nrOfPositions);
+			std::vector<uint32_t> remap(vertices.size());
+			std::vector<std::pair<uint32_t, uint32_t>> wedgeTargets{};
+
+			// Every pass does the cheapest collapses whose neighbourhoods do not overlap, then rebuilds the triangles
+			while (simplifiedIndices.size() > targetIndexCount)
+			{
+				const size_t nrOfTriangles = simplifiedIndices.size() / 3;
+
+				// Border positions may only slide along their border, corners and non manifold positions stay where they are
+				countEdges(simplifiedIndices);
+				std::fill(nrOfBorderEdges.begin(), nrOfBorderEdges.end(), 0);
+				std::fill(isLocked.begin(), isLocked.end(), false);
+
+				for (const auto& [edge, useCount] : edgeUseCounts)
+				{
+					const uint32_t start = uint32_t(edge >> 32);
+					const uint32_t end = uint32_t(edge & 0xFFFFFFFF);
+
+					if (useCount == 1)
+					{
+						nrOfBorderEdges[start]++;
+						nrOfBorderEdges[end]++;
+					}
+					else if (useCount > 2)
+					{
+						isLocked[start] = true;
+						isLocked[end] = true;
+					}
+				}
+
+				const auto canCollapse = [&](uint32_t from, uint32_t to)
+				{
+					if (isLocked[from]) return false;
+					if (nrOfBorderEdges[from] == 0) return true;
+					return nrOfBorderEdges[from] == 2 && edgeUseCounts[edgeKey(from, to)] == 1;
+				};
+
+				collapses.clear();
+				for (size_t i = 0; i < simplifiedIndices.size(); i++)
+				{
+					const uint32_t from = positionIds[simplifiedIndices[i]];
+					const uint32_t to = positionIds[simplifiedIndices[i - i % 3 + (i + 1) % 3]];
+
+					Quadric quadric = quadrics[from];
+					quadric.Add(quadrics[to]);
+
+					if (canCollapse(from, to)) collapses.push_back({ quadric.Evaluate(vertices[positionWedges[to][0]].Position), from, to });
+					if (canCollapse(to, from)) collapses.push_back({ quadric.Evaluate(vertices[positionWedges[from][0]].Position), to, from });
+				}
+				std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+				// Triangles around every vertex
+				std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+				for (const uint32_t index : simplifiedIndices) triangleOffsets[index + 1]++;
+				for (size_t idx = 1; idx < triangleOffsets.size(); idx++) triangleOffsets[idx] += triangleOffsets[idx - 1];
+
+				vertexTriangles.resize(simplifiedIndices.size());
+				insertPositions.assign(triangleOffsets.begin(), triangleOffsets.end() - 1);
+				for (size_t i = 0; i < simplifiedIndices.size(); i++) vertexTriangles[insertPositions[simplifiedIndices[i]]++] = uint32_t(i / 3);
+
+				std::fill(isTouched.begin(), isTouched.end(), false);
+				for (uint32_t idx = 0; idx < remap.size(); idx++) remap[idx] = idx;
+
+				const size_t nrOfTrianglesToRemove = (simplifiedIndices.size() - targetIndexCount + 2) / 3;
+				size_t nrOfRemovedTriangles{ 0 };
+
+				for (const Collapse& collapse : collapses)
+				{
+					if (nrOfRemovedTriangles >= nrOfTrianglesToRemove) break;
+					if (isTouched[collapse.from] || isTouched[collapse.to]) continue;
+
+					// Every wedge moves onto the one wedge of the target position it shares a triangle with,
+					// triangles that keep existing must not flip
+					bool isValid{ true };
+					int nrOfCollapsingTriangles{ 0 };
+					wedgeTargets.clear();
+
+					for (const uint32_t wedge : positionWedges[collapse.from])
+					{
+						uint32_t target{ UINT32_MAX };
+
+						for (uint32_t offset = triangleOffsets[wedge]; isValid && offset < triangleOffsets[wedge + 1]; offset++)
+						{
+							const uint32_t* pTriangle = &simplifiedIndices[vertexTriangles[offset] * 3];
+
+							bool isCollapsing{ false };
+							for (int corner{ 0 }; corner < 3; corner++)
+							{
+								if (positionIds[pTriangle[corner]] != collapse.to) continue;
+
+								if (target != UINT32_MAX && target != pTriangle[corner]) isValid = false;
+								target = pTriangle[corner];
+								isCollapsing = true;
+							}
+
+							if (isCollapsing)
+							{
+								nrOfCollapsingTriangles++;
+								continue;
+							}
+
+							Vector3 positions[3]{ vertices[pTriangle[0]].Position, vertices[pTriangle[1]].Position, vertices[pTriangle[2]].Position };
+							const Vector3 normalBefore = Vector3::Cross(positions[1] - positions[0], positions[2] - positions[0]);
+
+							for (int corner{ 0 }; corner < 3; corner++)
+							{
+								if (pTriangle[corner] == wedge) positions[corner] = vertices[positionWedges[collapse.to][0]].Position;
+							}
+
+							const Vector3 normalAfter = Vector3::Cross(positions[1] - positions[0], positions[2] - positions[0]);
+							if (Vector3::Dot(normalBefore, normalAfter) <= 0.f) isValid = false;
+						}
+
+						if (target == UINT32_MAX) isValid = false;
+						if (!isValid) break;
+
+						wedgeTargets.emplace_back(wedge, target);
+					}
+
+					if (!isValid) continue;
+
+					for (const auto& [wedge, target] : wedgeTargets)
+					{
+						remap[wedge] = target;
+
+						// Nothing else around the collapsed position changes this pass, so the tests above stay valid
+						for (uint32_t offset = triangleOffsets[wedge]; offset < triangleOffsets[wedge + 1]; offset++)
+						{
+							const uint32_t* pTriangle = &simplifiedIndices[vertexTriangles[offset] * 3];
+							for (int corner{ 0 }; corner < 3; corner++) isTouched[positionIds[pTriangle[corner]]] = true;
+						}
+					}
+
+					quadrics[collapse.to].Add(quadrics[collapse.from]);
+					nrOfRemovedTriangles += nrOfCollapsingTriangles;
+				}
+
+				if (nrOfRemovedTriangles == 0) break;
+
+				std::vector<uint32_t> remainingIndices{};
+				remainingIndices.reserve(simplifiedIndices.size());
+
+				for (size_t triangleIdx = 0; triangleIdx < nrOfTriangles; triangleIdx++)
+				{
+					const uint32_t index0 = remap[simplifiedIndices[triangleIdx * 3]];
+					const uint32_t index1 = remap[simplifiedIndices[triangleIdx * 3 + 1]];
+					const uint32_t index2 = remap[simplifiedIndices[triangleIdx * 3 + 2]];
+
+					if (index0 == index1 || index1 == index2 || index2 == index0) continue;
+
+					remainingIndices.push_back(index0);
+					remainingIndices.push_back(index1);
+					remainingIndices.push_back(index2);
+				}
+
+				simplifiedIndices = std::move(remainingIndices);
+			}
+		}
+
+		//Just parses vertices and indices, welding is optional
+		static bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding = true,
+			bool weldVertices = false)
 		{
 			std::ifstream file(filename);
 			if (!file)
@@ -99,7 +456,6 @@ namespace dae
 
 						vertices.push_back(vertex);
 						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
-						indices.push_back(uint32_t(vertices.size()) - 1);
 					}
 
 					indices.push_back(tempIndices[0]);
@@ -118,6 +474,9 @@ namespace dae
 				file.ignore(1000, '\n');
 			}
 
+			// Before the tangents, so every welded vertex accumulates the tangents of all its triangles
+			if (weldVertices) WeldVertices(vertices, indices);
+
 			//Cheap Tangent Calculations
 			for (uint32_t i = 0; i < indices.size(); i += 3)
 			{
@@ -136,7 +495,12 @@ namespace dae
 				const Vector3 edge1 = p2 - p0;
 				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
 				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
+
+				// No UV area, no tangent direction, skip it instead of spreading inf to every triangle sharing these vertices
+				const float uvArea = Vector2::Cross(diffX, diffY);
+				if (uvArea == 0.f) continue;
+
+				float r = 1.f / uvArea;
 
 				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
 				vertices[index0].Tangent += tangent;
@@ -60,6 +60,7 @@ int main(int argc, char* args[])
 	std::cout << ESC << YELLOW_TXT << "m" << "	[F9]  Cycle CullMode(BACK / FRONT / NONE)" << RESET << "\n";
 	std::cout << ESC << YELLOW_TXT << "m" << "	[F10] Toggle Uniform ClearColor(ON / OFF)	" << RESET << "\n";
 	std::cout << ESC << YELLOW_TXT << "m" << "	[F11] Toggle Print FPS(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << YELLOW_TXT << "m" << "	[L]   Toggle LOD Selection(ON / OFF)" << RESET << "\n";
 	std::cout << ESC << YELLOW_TXT << "m" << "	[F4] Exclusive (Point/Linear)" << RESET << "\n";
 
 	std::cout << ESC << GREEN_TXT << "m" << "[Key Bindings - HARDWARE]" << RESET << "\n";
@@ -69,7 +70,18 @@ int main(int argc, char* args[])
 	std::cout << ESC << PURPLE_TXT << "m" << "	[F5] Cycle Shading Mode(COMBINED / OBSERVED_AREA / DIFFUSE / SPECULAR)"<< RESET << "\n";
 	std::cout << ESC << PURPLE_TXT << "m" << "	[F6] Toggle NormalMap(ON / OFF)" << RESET << "\n";
 	std::cout << ESC << PURPLE_TXT << "m" << "	[F7] Toggle DepthBuffer Visualization(ON / OFF)" << RESET << "\n";
-	std::cout << ESC << PURPLE_TXT << "m" << "	[F8] Toggle BoundingBox Visualization(ON / OFF)" << RESET << "\n \n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[F8] Toggle BoundingBox Visualization(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[1] Toggle Multithreaded Tile Rasterization(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[2] Cycle Raster Kernel(FLOAT / FIXED POINT / SIMD)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[3] Toggle Hierarchical Block Rasterization(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[4] Toggle Deferred Visibility Buffer Shading(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[5] Toggle Hierarchical Z Rejection(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[6] Toggle Order Independent Transparency(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[7] Toggle Back To Front Sorting Of Transparent Triangles(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[8] Toggle Pipelined Frames(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[9] Toggle Meshlet Culling(ON / OFF)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[0] Cycle Max Anisotropy(1x / 2x / 4x / 8x / 16x)" << RESET << "\n";
+	std::cout << ESC << PURPLE_TXT << "m" << "	[B] Run Benchmarks" << RESET << "\n \n";
 
 	std::cout << ESC << CYAN_TXT << "m" << "Extra Features: " << RESET << "\n";
 	std::cout << ESC << CYAN_TXT << "m" << "	 Software transparency " << RESET << "\n";
@@ -123,6 +135,7 @@ int main(int argc, char* args[])
 			{
 				printTimer = 0.f;
 				std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+				pRenderer->PrintFrameStats();
 
 			}
 			